@@ -0,0 +1,204 @@
+#include "EdgeQueue.h"
+#include "Object.h"
+
+#include <cassert>
+
+#define ARITY 4
+
+/* Hedge::slot of the i'th parked edge, below the -1 of an unqueued one */
+#define PARKED_SLOT(i) (-2 - (i))
+
+bool
+EdgeQueue::Stale(Entry &e) {
+    return e.stamp != e.edge->stamp;
+}
+
+void
+EdgeQueue::Place(int i, Entry e) {
+    heap[i] = e;
+    e.edge->slot = i;
+}
+
+void
+EdgeQueue::SiftUp(int i) {
+    Entry e = heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / ARITY;
+        if (heap[parent].cost <= e.cost)
+            break;
+        Place(i, heap[parent]);
+        i = parent;
+    }
+    Place(i, e);
+}
+
+void
+EdgeQueue::SiftDown(int i) {
+    Entry e = heap[i];
+    int n = heap.size();
+    while (true) {
+        int first = ARITY * i + 1;
+        if (first >= n)
+            break;
+
+        int best = first;
+        for (int c = first + 1; c < first + ARITY && c < n; c++)
+            if (heap[c].cost < heap[best].cost)
+                best = c;
+
+        if (e.cost <= heap[best].cost)
+            break;
+        Place(i, heap[best]);
+        i = best;
+    }
+    Place(i, e);
+}
+
+/* Fill an empty queue with every edge at once, heapifying bottom up. */
+void
+EdgeQueue::Build(std::vector<Hedge*> &edges, std::vector<double> &costs) {
+    assert(heap.empty());
+    assert(edges.size() == costs.size());
+
+    heap.resize(edges.size());
+    for (unsigned int i = 0; i < edges.size(); i++) {
+        assert(costs[i] == costs[i]); // reject nans
+        Entry e = { costs[i], edges[i], edges[i]->stamp };
+        Place(i, e);
+    }
+    nlive = heap.size();
+
+    if (heap.empty())
+        return;
+    for (int i = ((int) heap.size() - 2) / ARITY; i >= 0; i--)
+        SiftDown(i);
+}
+
+/* Drop every entry, stale ones included. */
+void
+EdgeQueue::Clear() {
+    for (unsigned int i = 0; i < heap.size(); i++)
+        heap[i].edge->slot = -1;
+    for (unsigned int i = 0; i < parked.size(); i++)
+        parked[i].edge->slot = -1;
+    heap.clear();
+    parked.clear();
+    nlive = 0;
+}
+
+/* Set h's cost, adding an entry for it or reviving its stale one. */
+void
+EdgeQueue::Update(Hedge *h, double cost) {
+    assert(cost == cost); // reject nans
+
+    if (Parked(h))
+        Unlist(h);
+    if (h->slot < 0) {
+        Entry e = { cost, h, h->stamp };
+        heap.push_back(e);
+        h->slot = heap.size() - 1;
+        nlive++;
+        SiftUp(h->slot);
+        return;
+    }
+
+    Entry &e = heap[h->slot];
+    if (Stale(e)) {
+        e.stamp = h->stamp;
+        nlive++;
+    }
+
+    double old = e.cost;
+    e.cost = cost;
+    if (cost < old)
+        SiftUp(h->slot);
+    else
+        SiftDown(h->slot);
+}
+
+void
+EdgeQueue::Remove(Hedge *h) {
+    if (Parked(h)) {
+        Unlist(h);
+        return;
+    }
+    if (!Contains(h))
+        return;
+    h->stamp++;
+    nlive--;
+}
+
+bool
+EdgeQueue::Contains(Hedge *h) {
+    return h->slot >= 0 && !Stale(heap[h->slot]);
+}
+
+void
+EdgeQueue::DropTop() {
+    heap[0].edge->slot = -1;
+    Entry last = heap.back();
+    heap.pop_back();
+    if (!heap.empty()) {
+        Place(0, last);
+        SiftDown(0);
+    }
+}
+
+/* Cheapest live edge, or NULL if there isn't one. */
+Hedge*
+EdgeQueue::Top() {
+    while (!heap.empty() && Stale(heap[0]))
+        DropTop();
+    return (heap.empty()) ? NULL : heap[0].edge;
+}
+
+double
+EdgeQueue::TopCost() {
+    Top();
+    return heap[0].cost;
+}
+
+void
+EdgeQueue::Pop() {
+    Hedge *h = Top();
+    if (h == NULL)
+        return;
+    Remove(h);
+    DropTop();
+}
+
+/* Set the cheapest live edge aside until it's Unparked, Updated or
+ * Removed. */
+void
+EdgeQueue::Park() {
+    Hedge *h = Top();
+    if (h == NULL)
+        return;
+    Entry e = heap[0];
+    Pop();
+    h->slot = PARKED_SLOT(parked.size());
+    parked.push_back(e);
+}
+
+/* Put a parked edge back at the cost it had. */
+void
+EdgeQueue::Unpark(Hedge *h) {
+    Update(h, Unlist(h).cost);
+}
+
+bool
+EdgeQueue::Parked(Hedge *h) {
+    return h->slot < -1;
+}
+
+/* Take h out of the parked list. */
+EdgeQueue::Entry
+EdgeQueue::Unlist(Hedge *h) {
+    int i = PARKED_SLOT(h->slot);
+    Entry e = parked[i];
+    parked[i] = parked.back();
+    parked[i].edge->slot = PARKED_SLOT(i);
+    parked.pop_back();
+    h->slot = -1;
+    return e;
+}
@@ -0,0 +1,62 @@
+#ifndef _EDGEQUEUE_H_
+#define _EDGEQUEUE_H_
+
+#include <vector>
+
+class Hedge;
+
+/*
+ * Collapse queue: an indexed 4-ary min-heap of cached edge costs.
+ *
+ * Each entry belongs to one hedge of an edge, which keeps the entry's
+ * position in Hedge::slot so its cost can be changed in place. Removing
+ * an edge only bumps the hedge's stamp; the stale entry is thrown away
+ * when it reaches the top, or picked up again if the edge comes back.
+ *
+ * An edge that can't be taken yet is parked: set aside out of the heap
+ * with its cost, Hedge::slot pointing into the parked list instead, until
+ * it's Unparked, Updated or Removed.
+ */
+class EdgeQueue {
+  public:
+    EdgeQueue() : nlive(0) {}
+
+    void Build(std::vector<Hedge*> &edges, std::vector<double> &costs);
+    void Clear();
+    void Update(Hedge *h, double cost);
+    void Remove(Hedge *h);
+    bool Contains(Hedge *h);
+
+    Hedge* Top();
+    double TopCost();
+    void Pop();
+    void Park();
+    void Unpark(Hedge *h);
+
+    bool Parked(Hedge *h);
+    int nparked() { return parked.size(); }
+
+    /* live entries, not counting parked ones */
+    int size() { return nlive; }
+    bool empty() { return nlive == 0; }
+
+  private:
+    struct Entry {
+        double cost;
+        Hedge *edge;
+        unsigned int stamp; // live while it matches edge->stamp
+    };
+
+    std::vector<Entry> heap;
+    std::vector<Entry> parked;
+    int nlive;
+
+    bool Stale(Entry &e);
+    void Place(int i, Entry e);
+    void SiftUp(int i);
+    void SiftDown(int i);
+    void DropTop();
+    Entry Unlist(Hedge *h);
+};
+
+#endif /* _EDGEQUEUE_H_ */
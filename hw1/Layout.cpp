@@ -0,0 +1,169 @@
+#include "Layout.h"
+
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+using namespace glm;
+
+typedef unsigned long long Code;
+typedef pair<Code,int> Keyed;
+
+/* spread the low 21 bits of x out to every third bit */
+static Code
+spread(Code x) {
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffULL;
+    x = (x | x << 16) & 0x1f0000ff0000ffULL;
+    x = (x | x << 8)  & 0x100f00f00f00f00fULL;
+    x = (x | x << 4)  & 0x10c30c30c30c30c3ULL;
+    x = (x | x << 2)  & 0x1249249249249249ULL;
+    return x;
+}
+
+/* Morton code of p on a 2^21 grid over [lo, lo + size] */
+static Code
+morton(vec3 p, vec3 lo, float size) {
+    float scale = (size > 0.0f) ? 2097151.0f / size : 0.0f;
+    vec3 q = glm::min((p - lo) * scale, vec3(2097151.0f));
+    return spread((Code) q.x) | spread((Code) q.y) << 1 | spread((Code) q.z) << 2;
+}
+
+void
+MortonOrder(vector<vec3> &verts, vector<int> &tris) {
+    int nverts = verts.size(), nfaces = tris.size() / 3;
+    if (nverts == 0)
+        return;
+
+    vec3 lo = verts[0], hi = verts[0];
+    for (int i = 1; i < nverts; i++) {
+        lo = glm::min(lo, verts[i]);
+        hi = glm::max(hi, verts[i]);
+    }
+    vec3 extent = hi - lo;
+    float size = std::max(extent.x, std::max(extent.y, extent.z));
+
+    vector<Keyed> order(nverts);
+    #pragma omp parallel for
+    for (int i = 0; i < nverts; i++)
+        order[i] = Keyed(morton(verts[i], lo, size), i);
+    sort(order.begin(), order.end());
+
+    vector<vec3> sorted(nverts);
+    vector<int> remap(nverts);
+    for (int i = 0; i < nverts; i++) {
+        sorted[i] = verts[order[i].second];
+        remap[order[i].second] = i;
+    }
+    verts.swap(sorted);
+
+    vector<Keyed> faces(nfaces);
+    #pragma omp parallel for
+    for (int i = 0; i < nfaces; i++) {
+        vec3 centroid = (verts[remap[tris[3*i]]] + verts[remap[tris[3*i+1]]]
+                + verts[remap[tris[3*i+2]]]) / 3.0f;
+        faces[i] = Keyed(morton(centroid, lo, size), i);
+    }
+    sort(faces.begin(), faces.end());
+
+    vector<int> out(3 * nfaces);
+    for (int i = 0; i < nfaces; i++)
+        for (int k = 0; k < 3; k++)
+            out[3*i+k] = remap[tris[3*faces[i].second + k]];
+    tris.swap(out);
+}
+
+/* the next vertex to fan around once the current one is used up */
+static int
+skipDeadEnd(vector<int> &deadEnds, vector<int> &live, int &cursor) {
+    while (!deadEnds.empty()) {
+        int v = deadEnds.back();
+        deadEnds.pop_back();
+        if (live[v] > 0)
+            return v;
+    }
+    for (; cursor < (int) live.size(); cursor++)
+        if (live[cursor] > 0)
+            return cursor;
+    return -1;
+}
+
+void
+CacheOrder(vector<vec3> &verts, vector<int> &tris, int cacheSize) {
+    int nverts = verts.size(), nfaces = tris.size() / 3;
+    if (nfaces == 0)
+        return;
+
+    /* the faces around each vertex */
+    vector<int> first(nverts + 1, 0), around(3 * nfaces);
+    for (int i = 0; i < 3 * nfaces; i++)
+        first[tris[i] + 1]++;
+    for (int v = 0; v < nverts; v++)
+        first[v + 1] += first[v];
+    vector<int> fill(first.begin(), first.end() - 1);
+    for (int i = 0; i < 3 * nfaces; i++)
+        around[fill[tris[i]]++] = i / 3;
+
+    vector<int> live(nverts), stamp(nverts, 0);
+    for (int v = 0; v < nverts; v++)
+        live[v] = first[v + 1] - first[v];
+    vector<bool> emitted(nfaces, false);
+    vector<int> deadEnds, candidates, out;
+    out.reserve(3 * nfaces);
+
+    int time = cacheSize + 1, cursor = 0;
+    int fan = skipDeadEnd(deadEnds, live, cursor);
+    while (fan >= 0) {
+        /* emit every face left around fan */
+        candidates.clear();
+        for (int j = first[fan]; j < first[fan + 1]; j++) {
+            int f = around[j];
+            if (emitted[f])
+                continue;
+            emitted[f] = true;
+            for (int k = 0; k < 3; k++) {
+                int v = tris[3*f + k];
+                out.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - stamp[v] > cacheSize)
+                    stamp[v] = time++;
+            }
+        }
+
+        /* next, the candidate that will still be in the cache longest */
+        int next = -1, best = -1;
+        for (unsigned int j = 0; j < candidates.size(); j++) {
+            int v = candidates[j];
+            if (live[v] <= 0)
+                continue;
+            int priority = 0;
+            if (time - stamp[v] + 2 * live[v] <= cacheSize)
+                priority = time - stamp[v];
+            if (priority > best) {
+                best = priority;
+                next = v;
+            }
+        }
+        fan = (next >= 0) ? next : skipDeadEnd(deadEnds, live, cursor);
+    }
+
+    /* number vertices by first use, unused ones last */
+    vector<int> remap(nverts, -1);
+    vector<vec3> sorted;
+    sorted.reserve(nverts);
+    for (int i = 0; i < 3 * nfaces; i++) {
+        int &r = remap[out[i]];
+        if (r < 0) {
+            r = sorted.size();
+            sorted.push_back(verts[out[i]]);
+        }
+        out[i] = r;
+    }
+    for (int v = 0; v < nverts; v++)
+        if (remap[v] < 0)
+            sorted.push_back(verts[v]);
+    verts.swap(sorted);
+    tris.swap(out);
+}
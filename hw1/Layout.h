@@ -0,0 +1,25 @@
+#ifndef _LAYOUT_H_
+#define _LAYOUT_H_
+
+#include <vector>
+
+#include "core.h"
+
+/*
+ * Orderings of an indexed triangle list for memory locality. Both
+ * renumber verts and tris in place and leave the mesh itself alone.
+ *
+ * MortonOrder sorts vertices by the Morton (Z-order) code of their
+ * position in the bounding box, and faces by that of their centroid.
+ * Object::Build allocates vertices, faces and each face's three hedges in
+ * list order, so after this neighbours on the surface are mostly
+ * neighbours in the pools and in the sets that iterate them.
+ *
+ * CacheOrder reorders triangles for a GPU post-transform vertex cache of
+ * cacheSize entries (Sander, Nehab and Barczak's Tipsify), then numbers
+ * vertices in the order the triangles first use them.
+ */
+void MortonOrder(std::vector<glm::vec3> &verts, std::vector<int> &tris);
+void CacheOrder(std::vector<glm::vec3> &verts, std::vector<int> &tris, int cacheSize = 16);
+
+#endif /* _LAYOUT_H_ */
@@ -0,0 +1,228 @@
+#include "MeshBuffer.h"
+#include "Object.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+/* dirty slots closer together than this go up in one glBufferSubData */
+#define SLOT_RUN_GAP 16
+
+/* fixed-function style lighting for light 0, on the blended vertex */
+static const char *vertexShader =
+    "#version 120\n"
+    "attribute vec3 srcpos, dstpos, srcnorm, dstnorm;\n"
+    "attribute float start;\n"
+    "uniform float time, duration;\n"
+    "varying vec4 color;\n"
+    "void main() {\n"
+    "    float t = clamp((time - start) / duration, 0.0, 1.0);\n"
+    "    vec4 pos = vec4(mix(srcpos, dstpos, t), 1.0);\n"
+    "    vec3 n = normalize(gl_NormalMatrix * mix(srcnorm, dstnorm, t));\n"
+    "    vec4 eye = gl_ModelViewMatrix * pos;\n"
+    "    vec4 lpos = gl_LightSource[0].position;\n"
+    "    vec3 l = normalize(lpos.xyz - eye.xyz * lpos.w);\n"
+    "    vec3 h = normalize(l - normalize(eye.xyz));\n"
+    "    float diffuse = max(dot(n, l), 0.0);\n"
+    "    float specular = (diffuse > 0.0) ? pow(max(dot(n, h), 0.0), gl_FrontMaterial.shininess) : 0.0;\n"
+    "    color = gl_FrontLightModelProduct.sceneColor + gl_FrontLightProduct[0].ambient\n"
+    "          + gl_FrontLightProduct[0].diffuse * diffuse\n"
+    "          + gl_FrontLightProduct[0].specular * specular;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * pos;\n"
+    "}\n";
+
+static const char *fragmentShader =
+    "#version 120\n"
+    "varying vec4 color;\n"
+    "void main() {\n"
+    "    gl_FragColor = color;\n"
+    "}\n";
+
+static GLuint
+compile(GLenum type, const char *source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    GLint ok;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        fprintf(stderr, "Unable to compile geomorph shader:\n%s\n", log);
+        exit(5);
+    }
+    return shader;
+}
+
+MeshBuffer::MeshBuffer() : nindices(0), nslots(0), serial(-1), topology(-1) {
+    GLuint vs = compile(GL_VERTEX_SHADER, vertexShader),
+           fs = compile(GL_FRAGMENT_SHADER, fragmentShader);
+    program = glCreateProgram();
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    glLinkProgram(program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+
+    GLint ok;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        fprintf(stderr, "Unable to link geomorph shader:\n%s\n", log);
+        exit(5);
+    }
+
+    srcpos = glGetAttribLocation(program, "srcpos");
+    dstpos = glGetAttribLocation(program, "dstpos");
+    srcnorm = glGetAttribLocation(program, "srcnorm");
+    dstnorm = glGetAttribLocation(program, "dstnorm");
+    start = glGetAttribLocation(program, "start");
+    time = glGetUniformLocation(program, "time");
+    duration = glGetUniformLocation(program, "duration");
+
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ibo);
+}
+
+MeshBuffer::~MeshBuffer() {
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ibo);
+    glDeleteProgram(program);
+}
+
+/* Bring the slots up to the snapshot's, and the indices if they changed.
+ * If what's uploaded is at least as new as s.since, only s.dirty differ. */
+void
+MeshBuffer::Upload(const Simplifier::Snapshot &s) {
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    if (serial < 0 || serial < s.since || (int) s.slots.size() > nslots) {
+        nslots = s.slots.size();
+        glBufferData(GL_ARRAY_BUFFER, nslots * sizeof(Simplifier::Snapshot::Slot),
+                (nslots) ? &s.slots[0] : NULL, GL_DYNAMIC_DRAW);
+    } else {
+        unsigned int i = 0;
+        while (i < s.dirty.size()) {
+            unsigned int first = s.dirty[i], last = first;
+            for (i++; i < s.dirty.size() && s.dirty[i] <= last + SLOT_RUN_GAP; i++)
+                last = s.dirty[i];
+            glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(Simplifier::Snapshot::Slot),
+                    (last - first + 1) * sizeof(Simplifier::Snapshot::Slot), &s.slots[first]);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (s.topology != topology) {
+        nindices = s.indices.size();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, nindices * sizeof(GLuint),
+                (nindices) ? &s.indices[0] : NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        topology = s.topology;
+    }
+    serial = s.serial;
+}
+
+/* Upload the snapshot if it's new and draw it. */
+void
+MeshBuffer::Draw(const Simplifier::Snapshot &s) {
+    if (s.serial != serial)
+        Upload(s);
+
+    glUseProgram(program);
+    glUniform1f(time, MorphClock() - s.epoch);
+    glUniform1f(duration, MORPH_SECONDS);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    GLint attribs[5] = { srcpos, dstpos, srcnorm, dstnorm, start };
+    for (int i = 0; i < 5; i++) {
+        glEnableVertexAttribArray(attribs[i]);
+        glVertexAttribPointer(attribs[i], (i < 4) ? 3 : 1, GL_FLOAT, GL_FALSE,
+                sizeof(Simplifier::Snapshot::Slot), (GLvoid*) (i * 3 * sizeof(GLfloat)));
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glDrawElements(GL_TRIANGLES, nindices, GL_UNSIGNED_INT, 0);
+
+    for (int i = 0; i < 5; i++)
+        glDisableVertexAttribArray(attribs[i]);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+}
+
+void
+MeshBuffer::DrawPoints(const Simplifier::Snapshot &s) {
+    glPointSize(5.0f);
+    glColor3f(1.0f, 1.0f, 1.0f); // yellow
+
+    glBegin(GL_POINTS);
+    for (unsigned int i = 0; i < s.live.size(); i++)
+        glVertex3fv(s.slots[s.live[i]].dstpos);
+    glEnd();
+}
+
+static vec3
+toVec3(const float *p) {
+    return vec3(p[0], p[1], p[2]);
+}
+
+/* Where a slot's vertex is drawn at time t, as the shader blends it. */
+static vec3
+position(const Simplifier::Snapshot::Slot &slot, float t) {
+    return mix(toVec3(slot.srcpos), toVec3(slot.dstpos), t);
+}
+
+static float
+blend(const Simplifier::Snapshot::Slot &slot, double now) {
+    return std::min(1.0, std::max(0.0, (now - slot.start) / MORPH_SECONDS));
+}
+
+static void
+drawNormal(const Simplifier::Snapshot::Slot &slot, float t) {
+    vec3 norm = vec3(0.5f) * normalize(mix(toVec3(slot.srcnorm), toVec3(slot.dstnorm), t));
+    vec3 pos = position(slot, t);
+    vec3 end = pos + norm;
+
+    glVertex3fv( (GLfloat*) &pos );
+    glVertex3fv( (GLfloat*) &end );
+}
+
+static void
+drawNormal(const Simplifier::Snapshot &s, int face, double now) {
+    vec3 v[3];
+    for (int k = 0; k < 3; k++) {
+        const Simplifier::Snapshot::Slot &slot = s.slots[s.indices[3*face + k]];
+        v[k] = position(slot, blend(slot, now));
+    }
+    vec3 centroid = vec3(1.0/3.0) * (v[0] + v[1] + v[2]);
+    vec3 normal = vec3(0.5f) * normalize( cross(v[1]-v[0], v[2]-v[1]) );
+    vec3 end = centroid + normal;
+
+    glVertex3fv( (GLfloat*) &centroid );
+    glVertex3fv( (GLfloat*) &end );
+}
+
+void
+MeshBuffer::DrawNormals(const Simplifier::Snapshot &s, int vNorms, int fNorms) {
+    double now = MorphClock() - s.epoch;
+    glBegin(GL_LINES);
+    if (vNorms) {
+        glColor3f(0.0f, 0.0f, 1.0f);
+        for (unsigned int i = 0; i < s.live.size(); i++) {
+            const Simplifier::Snapshot::Slot &slot = s.slots[s.live[i]];
+            drawNormal(slot, blend(slot, now));
+        }
+    }
+    if (fNorms) {
+        glColor3f(0.0f, 1.0f, 0.0f);
+        for (int f = 0; f < (int) s.indices.size() / 3; f++)
+            drawNormal(s, f, now);
+    }
+    glEnd();
+}
@@ -0,0 +1,40 @@
+#ifndef _MESHBUFFER_H_
+#define _MESHBUFFER_H_
+
+#include "viewer.h"
+#include "Simplifier.h"
+
+/*
+ * GPU copy of an Object's Snapshot for drawing geomorphs, and everything
+ * else that draws one. This is the GL layer; the Object and Simplifier it
+ * draws from know nothing about GL.
+ *
+ * Every vertex has a slot holding where it's morphing from and to (both
+ * position and normal) and when the morph started. A vertex shader blends
+ * the pair by how far the time uniform is into the morph, so nothing on
+ * the CPU changes from frame to frame; slots are only uploaded when a new
+ * snapshot changed them, and the index buffer when its faces differ.
+ */
+class MeshBuffer {
+  public:
+    MeshBuffer();
+    ~MeshBuffer();
+
+    void Draw(const Simplifier::Snapshot &s);
+    void DrawNormals(const Simplifier::Snapshot &s, int vNorms, int fNorms);
+    void DrawPoints(const Simplifier::Snapshot &s);
+
+  private:
+    GLuint program, vbo, ibo;
+    GLint srcpos, dstpos, srcnorm, dstnorm, start;
+    GLint time, duration;
+    int nindices, nslots;
+    int serial, topology; // of the snapshot uploaded
+
+    void Upload(const Simplifier::Snapshot &s);
+
+    MeshBuffer(const MeshBuffer&);
+    MeshBuffer& operator=(const MeshBuffer&);
+};
+
+#endif /* _MESHBUFFER_H_ */
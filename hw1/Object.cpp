@@ -1,12 +1,29 @@
 #include <cstdio>
+#include <cfloat>
+#include <cstring>
 #include <map>
 #include <algorithm>
 #include <vector>
 #include <cstdio>
+#include <cmath>
+#include <new>
+
+#include "timer.h"
 
 #include "Object.h"
+#include "Policy.h"
+#include "Weld.h"
+#include "Layout.h"
 
+#ifndef DEBUG
 #define DEBUG 0
+#endif
+
+/* debug builds check around every operation, and the whole mesh every
+ * CHECK_EVERY operations (never if 0) */
+#ifndef CHECK_EVERY
+#define CHECK_EVERY 1000
+#endif
 
 #if DEBUG
     #define DEBUG_ASSERT(cnd) assert((cnd));
@@ -17,8 +34,6 @@
 using namespace glm;
 using namespace std;
 
-extern int g_qem;
-
 typedef std::pair<Vertex*,Vertex*> VVpair;
 
 void glm_print(glm::vec3 v) {
@@ -50,53 +65,147 @@ glm::vec4 homogenize(glm::vec3 v) {
 }
 
 
-Object::Object(FILE* input) {
-    int scanned;
+Object::Object()
+    : reindex(true), morphend(0.0), loadTime(0.0), queueTime(0.0),
+      engine(GetEngine(QEM_OPTIMAL)), deferring(false), nchecked(0) {
+}
+
+Object::Object(FILE* input, float weld, bool reorder)
+    : reindex(true), morphend(0.0), loadTime(0.0), queueTime(0.0),
+      engine(GetEngine(QEM_OPTIMAL)), deferring(false), nchecked(0) {
+    bool ok = Read(input, weld, reorder);
+    assert(ok && "Could not read OFF file.");
+}
+
+Object::Object(vector<vec3> &verts, vector<int> &tris)
+    : reindex(true), morphend(0.0), loadTime(0.0), queueTime(0.0),
+      engine(GetEngine(QEM_OPTIMAL)), deferring(false), nchecked(0) {
+    Build(verts, tris);
+}
+
+/* Drop the whole mesh, keeping the pools' memory for the next one. */
+void
+Object::Clear() {
+    queue.Clear();
+    faces.clear();
+    hedges.clear();
+    vertices.clear();
+    vsplits.clear();
+    redo.clear();
+    deferred.clear();
+    dirty.clear();
+    splitPool.Clear();
+    hedgePool.Clear();
+    facePool.Clear();
+    vertexPool.Clear();
+    reindex = true;
+    morphend = loadTime = queueTime = 0.0;
+    nchecked = 0;
+}
+
+/* Replace the mesh with a triangle mesh read from an OFF file, welding
+ * vertices within weld of each other unless it's negative, and laying it
+ * out along a Morton curve if reorder is set. Returns false, leaving the
+ * Object empty, if the file isn't one. */
+bool
+Object::Read(FILE* input, float weld, bool reorder) {
+    Clear();
+    double start = Now();
 
     // Scan OFF header
     char buf[4];
-    scanned = fscanf(input, "%4s\n", (char*)  &buf);
-    assert(scanned == 1 && string(buf) == "OFF" && "Could not read OFF header.");
+    if (fscanf(input, "%3s", buf) != 1 || strcmp(buf, "OFF")) {
+        fprintf(stderr, "Could not read OFF header.\n");
+        return false;
+    }
 
     // Scan number of faces, verts, and numthree.
     int numverts, numfaces, numthree;
-    scanned = fscanf(input, "%d %d %d\n", &numverts, &numfaces, &numthree);
-    assert(scanned == 3 && "Could not read number of verts or faces from OFF file.");
+    if (fscanf(input, "%d %d %d", &numverts, &numfaces, &numthree) != 3 ||
+            numverts < 0 || numfaces < 0) {
+        fprintf(stderr, "Could not read number of verts or faces from OFF file.\n");
+        return false;
+    }
+
+    vector<vec3> verts;
+    vector<int> tris;
+    verts.reserve(numverts);
+    tris.reserve(3 * numfaces);
+
+    // Scan all vertices
+    for(int i = 0; i < numverts; i++) {
+        double x, y, z;
+        if (fscanf(input, "%lf %lf %lf", &x, &y, &z) != 3) {
+            fprintf(stderr, "Read vertex with a non-three number of coords.\n");
+            return false;
+        }
+        verts.push_back(vec3(x, y, z));
+    }
+
+    // Scan all faces
+    for(int i = 0; i < numfaces; i++) {
+        int valence, vi[3];
+        if (fscanf(input, "%d %d %d %d", &valence, &vi[0], &vi[1], &vi[2]) != 4 ||
+                valence != 3) {
+            fprintf(stderr, "Read a non-triangle face.\n");
+            return false;
+        }
+        for (int k = 0; k < 3; k++) {
+            if (vi[k] < 0 || vi[k] >= numverts) {
+                fprintf(stderr, "Read a face with a bad vertex index.\n");
+                return false;
+            }
+            tris.push_back(vi[k]);
+        }
+    }
+
+    if (weld >= 0.0f) {
+        vector<int> remap;
+        WeldVertices(verts, weld, remap);
+        RemapTris(tris, remap);
+        CompactVerts(verts, tris);
+    }
+    if (reorder)
+        MortonOrder(verts, tris);
+
+    loadTime = Now() - start;
+    Build(verts, tris);
+    return true;
+}
 
-    faces = std::set<Face*>();
-    hedges = std::set<Hedge*>();
-    vertices = std::set<Vertex*>();
+/* Link up the half-edge structure for an indexed triangle list and queue
+ * its edges. Vertex ids are their indices in verts. */
+void
+Object::Build(vector<vec3> &verts, vector<int> &tris) {
+    double start = Now();
+    int numverts = verts.size(),
+        numfaces = tris.size() / 3;
 
-    // temporary vector to hold indexed vertices
+    // temporary vectors to hold indexed vertices and faces
     vector<Vertex*> vertvec;
     vertvec.reserve(numverts);
+    vector<Face*> facevec;
+    facevec.reserve(numfaces);
     vsplits.reserve(numverts);
 
-    // Scan all vertices
     for(int i = 0; i < numverts; i++) {
-        double x, y, z;
-        scanned = fscanf(input, "%lf %lf %lf\n", &x, &y, &z);
-        assert(scanned == 3 && "Read vertex with a non-three number of coords.");
-
-        Vertex *newv = new Vertex(vec3(x, y, z));
+        Vertex *newv = new (vertexPool.Alloc()) Vertex(verts[i]);
+        newv->id = i;
         vertices.insert(newv);
         vertvec.push_back(newv);
     }
 
-    // Scan all faces
     for(int i = 0; i < numfaces; i++) {
-        int valence, vi0, vi1, vi2;
-        scanned = fscanf(input, "%d %d %d %d\n", &valence, &vi0, &vi1, &vi2);
-        assert(scanned == 4 && "Read a non-triangle face.");
-
-        Face *face = new Face();
-        Vertex *v0 = vertvec[vi0],
-               *v1 = vertvec[vi1],
-               *v2 = vertvec[vi2];
-
-        Hedge *h0 = new Hedge(v0, NULL, face);
-        Hedge *h2 = new Hedge(v2, h0,   face);
-        Hedge *h1 = new Hedge(v1, h2,   face);
+        Face *face = new (facePool.Alloc()) Face();
+        face->id = i;
+        facevec.push_back(face);
+        Vertex *v0 = vertvec[tris[3*i]],
+               *v1 = vertvec[tris[3*i+1]],
+               *v2 = vertvec[tris[3*i+2]];
+
+        Hedge *h0 = new (hedgePool.Alloc()) Hedge(v0, NULL, face);
+        Hedge *h2 = new (hedgePool.Alloc()) Hedge(v2, h0,   face);
+        Hedge *h1 = new (hedgePool.Alloc()) Hedge(v1, h2,   face);
         h0->next = h1;
 
         faces.insert(face);
@@ -112,17 +221,115 @@ Object::Object(FILE* input) {
     foreach (Hedge* h, this->hedges)
         h->pair = vtoe[VVpair(h->oppv(),h->v)];
 
+    // An edge with more than two faces (welding can make them) keeps one
+    // pair; the other faces see a boundary there
+    foreach (Hedge* h, this->hedges)
+        if (h->pair != NULL && h->pair->pair != h)
+            h->pair = NULL;
+
+    // Vertices are found by circulating a single fan, so give each extra
+    // fan around a non-manifold vertex its own copy of the vertex
+    set<Hedge*> circulated;
+    set<Vertex*> claimed;
+    foreach (Hedge* h, this->hedges) {
+        if (circulated.count(h))
+            continue;
+
+        Vertex *v = h->v;
+        if (!claimed.insert(v).second) {
+            int id = v->id;
+            v = new (vertexPool.Alloc()) Vertex(v->dstval);
+            v->id = id;
+            vertices.insert(v);
+        }
+
+        v->edge = h;
+        foreach (Hedge* fh, v->Hedges()) {
+            fh->v = v;
+            circulated.insert(fh);
+        }
+    }
+
+    loadTime += Now() - start;
+    start = Now();
+
+    // Compute Q values: each face's plane once, then summed around each
+    // vertex. Every loop writes only its own element, so they run in
+    // parallel when built with OpenMP.
+    vector<Quadric> planes(numfaces);
+    #pragma omp parallel for
+    for (int i = 0; i < numfaces; i++)
+        planes[i] = facevec[i]->GetQ();
+
+    vector<Vertex*> allverts(vertices.begin(), vertices.end());
+    #pragma omp parallel for
+    for (int i = 0; i < (int) allverts.size(); i++) {
+        Vertex *v = allverts[i];
+        v->Q = Quadric();
+        foreach(Hedge* h, v->Hedges())
+            v->Q += planes[h->f->id];
+    }
+
+    // Put edges in priority queue, once per pair
+    Rescore();
+
+    queueTime = Now() - start;
+
+    // Give everything a buffer slot and a normal
+    int index = 0;
+    foreach(Vertex* v, vertices) {
+        v->index = index++;
+        if (v->edge != NULL)
+            v->srcnorm = v->dstnorm = v->Normal();
+        Touch(v);
+    }
+
     DEBUG_ASSERT( this->check() );
+}
 
-    // Compute Q values
-    foreach(Vertex* v, vertices)
-        v->UpdateQ();
 
-    // Put edges in priority queue
-    foreach(Hedge* e, hedges)
-        e->handle = queue.push(e);
+/* Flatten the current mesh into an indexed triangle list. If ids is given
+ * it gets the id of each vertex written. */
+void
+Object::Export(vector<vec3> &verts, vector<int> &tris, vector<int> *ids) {
+    map<Vertex*,int> index;
+    verts.clear();
+    tris.clear();
+    if (ids)
+        ids->clear();
+
+    foreach(Vertex *v, vertices) {
+        index[v] = verts.size();
+        verts.push_back(v->dstval);
+        if (ids)
+            ids->push_back(v->id);
+    }
+
+    foreach(Face *f, faces) {
+        tris.push_back(index[f->edge->v]);
+        tris.push_back(index[f->edge->next->v]);
+        tris.push_back(index[f->edge->next->next->v]);
+    }
 }
 
+void
+Object::Write(FILE *output) {
+    vector<vec3> verts;
+    vector<int> tris;
+    Export(verts, tris);
+    Write(output, verts, tris);
+}
+
+/* Write an indexed triangle list, first put in vertex cache order. */
+void
+Object::Write(FILE *output, vector<vec3> &verts, vector<int> &tris) {
+    CacheOrder(verts, tris);
+    fprintf(output, "OFF\n%d %d 0\n", (int) verts.size(), (int) tris.size() / 3);
+    for (unsigned int i = 0; i < verts.size(); i++)
+        fprintf(output, "%f %f %f\n", verts[i].x, verts[i].y, verts[i].z);
+    for (unsigned int i = 0; i < tris.size(); i += 3)
+        fprintf(output, "3 %d %d %d\n", tris[i], tris[i+1], tris[i+2]);
+}
 
 void
 Object::SetCenterSize(float *center, float *size) {
@@ -147,85 +354,119 @@ Object::SetCenterSize(float *center, float *size) {
     *size = sqrtf(*size);
 }
 
+/* Restart the morphs of everything touched since the last frame. */
+void
+Object::UpdateMorphs() {
+    double now = MorphClock();
+    foreach(Vertex *v, dirty)
+        v->Retarget(now);
+    if (!dirty.empty())
+        morphend = now + MORPH_SECONDS;
+}
+
 bool
-Object::Render() {
-    bool done = true;
+Object::Morphing() {
+    return !dirty.empty() || MorphClock() < morphend;
+}
 
-    glBegin(GL_TRIANGLES);
-    foreach(Face* f, faces)
-        done &= f->Render();
-    glEnd();
+/* Everything check() asserts about one hedge; returns whether it's on
+ * the boundary. */
+bool
+Object::checkHedge(Hedge *h) {
+    /* next is defined */
+    assert(h->next);
+    assert(h->next->next);
+    assert(h->next->next->next == h);
+
+    /* pair pointers are reflexive */
+    if (h->pair != NULL)
+        assert(h == h->pair->pair);
+
+    /* self isn't a pair */
+    assert(h->pair != h);
+
+    /* next pointers are circular */
+    assert(h != h->next);
+    assert(h != h->next->next);
+    assert(h == h->next->next->next);
+
+    /* vertex and next pointers are in different directions */
+    assert(h->v == h->prev()->oppv());
+    assert(h->oppv() == h->next->v);
+
+    /* v is not oppv */
+    if (h->pair != NULL)
+        assert(h->v != h->oppv());
+
+    /* edges in opp direction */
+    if (h->pair != NULL) {
+        assert(h->v == h->pair->oppv());
+        assert(h->pair->v == h->oppv());
+    }
 
-    return done;
-}
+    /* neighbors around vertex have same vertex */
+    if (h->pair != NULL) {
+        assert(h->next->v == h->pair->v);
+        assert(h->v == h->pair->next->v);
+    }
 
-int Object::check() {
+    /* membership checks */
+    assert( faces.find(h->f) != faces.end() );
+    assert( hedges.find(h->next) != hedges.end() );
+    if ( vertices.find(h->v) == vertices.end() ) {
+        printf("missing vertex %lx\n", (long int) h->v);
+        assert( vertices.find(h->v) != vertices.end() );
+    }
+    if (h->pair)
+        assert( hedges.find(h->pair) != hedges.end() );
 
-    int num_boundaries = 0;
-    int hno = 0;
-    foreach(Hedge* h, this->hedges) {
-        /* next is defined */
-        assert(h->next);
-        assert(h->next->next);
-        assert(h->next->next->next == h);
-
-        /* pair pointers are reflexive */
-        if (h->pair != NULL)
-            assert(h == h->pair->pair);
+    /* each edge is queued or parked once, unless a Seek is still to
+     * queue them */
+    if (!deferring) {
+        bool queued = queue.Contains(h) || queue.Parked(h);
+        if (h->pair)
+            assert( queued != (queue.Contains(h->pair) || queue.Parked(h->pair)) );
         else
-            num_boundaries++;
+            assert( queued );
+    }
 
-        /* self isn't a pair */
-        assert(h->pair != h);
+    return h->pair == NULL;
+}
 
-        /* next pointers are circular */
-        assert(h != h->next);
-        assert(h != h->next->next);
-        assert(h == h->next->next->next);
+/* Everything check() asserts about the fan around v; returns its size. */
+int
+Object::checkFan(Vertex *v) {
+    /* vertices have edges */
+    assert(v->edge != NULL);
 
-        /* vertex and next pointers are in different directions */
-        assert(h->v == h->prev()->oppv());
-        assert(h->oppv() == h->next->v);
+    int n = 0;
+    foreach(Hedge* h, v->Hedges()) {
+        /* Hedges returns hedges that leave this */
+        assert(h->v == v);
 
-        /* v is not oppv */
-        if (h->pair != NULL)
-            assert(h->v != h->oppv());
+        /* membership check */
+        assert( hedges.find(h) != hedges.end() );
 
-        /* edges in opp direction */
-        if (h->pair != NULL) {
-            assert(h->v == h->pair->oppv());
-            assert(h->pair->v == h->oppv());
-        }
+        n++;
+    }
+    return n;
+}
 
-        /* neighbors around vertex have same vertex */
-        if (h->pair != NULL) {
-            assert(h->next->v == h->pair->v);
-            assert(h->v == h->pair->next->v);
-        }
+int Object::check() {
 
-        /* membership checks */
-        assert( faces.find(h->f) != faces.end() );
-        assert( hedges.find(h->next) != hedges.end() );
-        if ( vertices.find(h->v) == vertices.end() ) {
-            printf("missing vertex %lx\n", (long int) h->v);
-            assert( vertices.find(h->v) != vertices.end() );
-        }
-        if (h->pair)
-            assert( hedges.find(h->pair) != hedges.end() );
-    }
+    int num_boundaries = 0;
+    foreach(Hedge* h, this->hedges)
+        num_boundaries += checkHedge(h);
 
-    foreach(Vertex *v, vertices) {
-        /* Hedges returns hedges that point to this */
-        foreach(Hedge* h, v->edges)
-            assert(h->v == v);
+    if (!deferring)
+        assert( queue.size() + queue.nparked() == ((int) hedges.size() + num_boundaries) / 2 );
 
-        /* vertices have edges */
-        assert(v->edges.size() > 0);
+    int num_fan_hedges = 0;
+    foreach(Vertex *v, vertices)
+        num_fan_hedges += checkFan(v);
 
-        /* membership check */
-        foreach(Hedge* e, v->edges)
-            assert( hedges.find(e) != hedges.end() );
-    }
+    /* every hedge is reachable by circulating around its vertex */
+    assert(num_fan_hedges == (int) hedges.size());
 
     foreach(Face *f, faces) {
         /* membership check */
@@ -241,14 +482,59 @@ int Object::check() {
     return 1;
 }
 
+/* The checks check() makes, on the faces around v and its neighbours and
+ * on their fans: all that an operation centred on v can have broken. */
+int
+Object::check(Vertex *v) {
+    assert( vertices.find(v) != vertices.end() );
+
+    set<Vertex*> ring;
+    ring.insert(v);
+    foreach(Hedge* h, v->Hedges()) {
+        ring.insert(h->oppv());
+        ring.insert(h->prev()->v);
+    }
+
+    set<Face*> around;
+    foreach(Vertex *r, ring) {
+        checkFan(r);
+        foreach(Hedge* h, r->Hedges())
+            around.insert(h->f);
+    }
+
+    foreach(Face *f, around) {
+        assert( faces.find(f) != faces.end() );
+        assert( hedges.find(f->edge) != hedges.end() );
+        Hedge *h = f->edge;
+        for (int k = 0; k < 3; k++, h = h->next)
+            checkHedge(h);
+    }
+
+    return 1;
+}
+
+/* Check around v after an operation there, and the whole mesh every
+ * CHECK_EVERY operations. A collapse that took the last faces around v
+ * removes it, leaving nothing to check around but that it's gone. */
+int
+Object::checkOp(Vertex *v) {
+    if (v->edge != NULL)
+        check(v);
+    else
+        assert( vertices.find(v) == vertices.end() );
+    if (CHECK_EVERY > 0 && ++nchecked % CHECK_EVERY == 0)
+        check();
+    return 1;
+}
+
 Hedge::Hedge(Vertex *v, Hedge *next, Face *f) :
-    v(v), next(next), f(f), pair(NULL)
+    v(v), next(next), f(f), pair(NULL), slot(-1), stamp(0)
 {
-    v->PullHedge(this);
+    v->edge = this;
     f->edge = this;
 }
 
-Face::Face() : edge(NULL)
+Face::Face() : edge(NULL), id(-1)
 { }
 
 vec3
@@ -267,45 +553,9 @@ Face::CurrentNormal() {
     return normalize( cross(v1-v0, v2-v1) );
 }
 
-bool
-Face::Render() {
-    bool done = true;
-    done &= this->edge->Render();
-    done &= this->edge->next->Render();
-    done &= this->edge->next->next->Render();
-    return done;
-}
-
-bool
-Vertex::Render() {
-    vec3 pos = this->Position(),
-         norm = this->CurrentNormal();
-    glNormal3fv( (GLfloat*) &norm  );
-    glVertex3fv( (GLfloat*) &pos );
-
-    if (framesleft > 0)
-        framesleft -= 1;
-
-    return framesleft == 0;
-}
-
-bool
-Hedge::Render() {
-    return v->Render();
-}
-
-inline Hedge*
-Hedge::prev() {
-    return this->next->next;
-}
-
-inline Vertex*
-Hedge::oppv() {
-    return this->next->v;
-}
-
 Vertex::Vertex(vec3 val) :
-    dstval(val), srcval(val), framesleft(0)
+    srcval(val), dstval(val), morphstart(-MORPH_SECONDS), index(-1), dirty(false),
+    edge(NULL), id(-1), locked(false)
 { }
 
 void
@@ -317,64 +567,16 @@ Hedge::SetPair(Hedge* o) {
 
 int
 Vertex::valence() {
-    return edges.size();
-}
-
-void
-Object::DrawPoints() {
-    glPointSize(5.0f);
-    glColor3f(1.0f, 1.0f, 1.0f); // yellow
-
-    glBegin(GL_POINTS);
-    foreach(Vertex* v, vertices)
-        glVertex3fv(&v->dstval.x);
-    glEnd();
-}
-
-void
-Object::DrawNormals(int vNorms, int fNorms) {
-    glBegin(GL_LINES);
-    if (vNorms) {
-        glColor3f(0.0f, 0.0f, 1.0f);
-        foreach(Vertex *v, vertices)
-            v->DrawNormal();
-    }
-    if (fNorms) {
-        glColor3f(0.0f, 1.0f, 0.0f);
-        foreach(Face *f, faces)
-            f->DrawNormal();
-    }
-    glEnd();
-}
-
-void
-Vertex::DrawNormal() {
-    vec3 norm = vec3(0.5f) * CurrentNormal();
-    vec3 pos = Position();
-    vec3 end = pos + norm;
-
-    glVertex3fv( (GLfloat*) &pos );
-    glVertex3fv( (GLfloat*) &end );
-}
-
-void
-Face::DrawNormal() {
-    vec3 centroid = vec3(1.0/3.0) *
-        (edge->v->Position()+ edge->next->v->Position()+ edge->next->next->v->Position());
-    vec3 normal = vec3(0.5f) * CurrentNormal();
-    vec3 end = centroid + normal;
-
-    glVertex3fv( (GLfloat*) &centroid );
-    glVertex3fv( (GLfloat*) &end );
+    HedgeFan fan = Hedges();
+    return std::distance(fan.begin(), fan.end());
 }
 
 glm::vec3
 Vertex::Normal() {
     vec3 normal(0.0f);
-    Hedge *e;
 
-    assert(edges.size() > 0);
-    foreach(Hedge *neighbor, edges)
+    assert(edge != NULL);
+    foreach(Hedge *neighbor, Hedges())
         normal += neighbor->f->Normal();
 
     return normalize( normal );
@@ -383,65 +585,162 @@ Vertex::Normal() {
 glm::vec3
 Vertex::CurrentNormal() {
     vec3 normal(0.0f);
-    Hedge *e;
 
-    assert(edges.size() > 0);
-    foreach(Hedge *neighbor, edges)
+    assert(edge != NULL);
+    foreach(Hedge *neighbor, Hedges())
         normal += neighbor->f->CurrentNormal();
 
     return normalize( normal );
 }
 
+/* Cheapest edge that can be collapsed. The cheaper ones that can't are
+ * parked until a change around them requeues them. */
 Hedge*
 Object::PeekNext() {
-    if (g_qem)
-        return queue.top();
-    else
-        return *(hedges.begin());
+    Hedge *e;
+    while ((e = queue.Top()) != NULL && !e->IsCollapsible())
+        queue.Park();
+    return e;
+}
+
+/* Switch policies, rescoring every edge still in the mesh. */
+void
+Object::SetEngine(Engine *e) {
+    engine = e;
+    Rescore();
+}
+
+/* Rebuild the queue from scratch, once per pair. */
+void
+Object::Rescore() {
+    queue.Clear();
+
+    vector<Hedge*> edges;
+    foreach(Hedge* h, hedges)
+        if (h->pair == NULL || h < h->pair)
+            edges.push_back(h);
+
+    vector<double> costs;
+    engine->Cost(edges, costs);
+    queue.Build(edges, costs);
+}
+
+/* Each edge has one queue entry, held by either of its hedges; this is
+ * the one to score e's edge under. */
+Hedge*
+Object::Holder(Hedge *e) {
+    Hedge *p = e->pair;
+    if (p != NULL && (queue.Contains(p) || queue.Parked(p))) {
+        queue.Remove(e); // two edges merged by a collapse
+        return p;
+    }
+    return e;
+}
+
+/* Recompute costs of the edges of faces around v. */
+void
+Object::RequeueFan(Vertex *v) {
+    requeued.clear();
+    foreach(Hedge* h, v->Hedges()) {
+        requeued.push_back(h);
+        requeued.push_back(h->next);
+        requeued.push_back(h->next->next);
+    }
+    engine->Requeue(this, requeued);
+}
+
+/* Whether an edge can be collapsed depends on the fans at its ends, so
+ * any parked edge at a vertex whose fan changed goes back in the queue. */
+void
+Object::Unpark(Vertex *v) {
+    foreach(Hedge* h, v->Hedges()) {
+        if (queue.Parked(h))
+            queue.Unpark(h);
+        if (queue.Parked(h->next->next))
+            queue.Unpark(h->next->next);
+    }
 }
 
 VertexSplit*
 Object::CollapseNext() {
-    Hedge *e0 = PeekNext();
-    return this->Collapse(e0, e0->GetVBar());
+    return engine->CollapseNext(this);
+}
+
+/* first hedge leaving v that isn't in removed[6] */
+static Hedge*
+survivingEdge(Vertex *v, Hedge **removed) {
+    foreach(Hedge *h, v->Hedges())
+        if (std::find(removed, removed+6, h) == removed+6)
+            return h;
+    return NULL;
 }
 
 VertexSplit*
 Object::Collapse(Hedge *e00, vec4 newloc) {
-    // -------------------------------------------------------
-    // save state
+    DropRedo();
+    VertexSplit *state = new (splitPool.Alloc()) VertexSplit(e00);
+    Contract(state, newloc);
 
-    Hedge *e01 = e00->next,
-          *e02 = e01->next,
-          *e10 = e00->pair,
-          *e11 = (e10) ? e10->next : NULL,
-          *e12 = (e11) ? e11->next : NULL;
+    /* collapse fins */
+    Hedge *e02 = state->e02,
+          *e12 = state->e12;
+    if (e02->pair && e02->pair->IsDegenerate()) {
+        vec3 &p = e02->pair->v->dstval;
+        vec4 newloc = vec4(p.x, p.y, p.z, 1.0);
+        state->degenA = this->Collapse(e02->pair, newloc);
+    }
+    if (e12 && e12->pair && e12->pair->IsDegenerate()) {
+        vec3 &p = e12->pair->v->dstval;
+        vec4 newloc = vec4(p.x, p.y, p.z, 1.0);
+        state->degenB = this->Collapse(e12->pair, newloc);
+    }
 
-    Face *f0 = (e00) ? e00->f : NULL,
-         *f1 = (e10) ? e10->f : NULL;
+    Refresh(state->target);
 
-    Vertex *midpoint = e00->v,
-           *oldpoint = e00->oppv(),
-           *vA = (e02) ? e02->v : NULL,
-           *vB = (e12) ? e12->v : NULL;
+    DEBUG_ASSERT( this->checkOp(state->target) );
 
-    bool delete_mp = false,
-         delete_va = false,
-         delete_vb = false;
+    return state;
+}
 
-    VertexSplit *state = new VertexSplit(e00);
+/* The surgery for a collapse described by state, without its fins. */
+void
+Object::Contract(VertexSplit *state, vec4 newloc) {
+    // -------------------------------------------------------
+    // save state
 
-    if (e00) DEBUG_ASSERT(midpoint->edges.find(e00) != midpoint->edges.end());
-    if (e11) DEBUG_ASSERT(midpoint->edges.find(e11) != midpoint->edges.end());
-    if (e01) DEBUG_ASSERT(oldpoint->edges.find(e01) != oldpoint->edges.end());
-    if (e10) DEBUG_ASSERT(oldpoint->edges.find(e10) != oldpoint->edges.end());
-    if (e02) DEBUG_ASSERT(vA->edges.find(e02) != vA->edges.end());
-    if (e12) DEBUG_ASSERT(vB->edges.find(e12) != vB->edges.end());
+    Hedge *e00 = state->e00,
+          *e01 = state->e01,
+          *e02 = state->e02,
+          *e10 = state->e10,
+          *e11 = state->e11,
+          *e12 = state->e12;
+
+    Face *f0 = state->f0,
+         *f1 = state->f1;
+
+    Vertex *midpoint = state->target,
+           *oldpoint = state->newpoint,
+           *vA = state->vA,
+           *vB = state->vB;
+
+    /* pick hedges to keep the vertices reachable while the fans are
+     * still intact */
+    Hedge *removed[6] = { e00, e01, e02, e10, e11, e12 };
+    Hedge *mp_edge = survivingEdge(midpoint, removed);
+    if (mp_edge == NULL)
+        mp_edge = survivingEdge(oldpoint, removed);
+    Hedge *va_edge = (vA) ? survivingEdge(vA, removed) : NULL,
+          *vb_edge = (vB) ? survivingEdge(vB, removed) : NULL;
 
     // -------------------------------------------------------
     // make updates
 
     midpoint->MoveTo( newloc );
+    state->collapse_loc = midpoint->dstval;
+
+    // hand the old vertex's hedges to the midpoint
+    foreach(Hedge* hedge, oldpoint->Hedges())
+        hedge->v = midpoint;
 
     // fix up pairs
     if (e01 && e01->pair) e01->pair->SetPair(e02->pair);
@@ -449,109 +748,112 @@ Object::Collapse(Hedge *e00, vec4 newloc) {
     if (e11 && e11->pair) e11->pair->SetPair(e12->pair);
     if (e12 && e12->pair) e12->pair->SetPair(e11->pair);
 
-    // update vertex points from edges pointing to old vertex
-    if (e00) midpoint->edges.erase(e00);
-    if (e11) midpoint->edges.erase(e11);
-    if (e01) oldpoint->edges.erase(e01);
-    if (e10) oldpoint->edges.erase(e10);
-    if (vA)  vA->edges.erase(e02);
-    if (vB)  vB->edges.erase(e12);
-
-    foreach(Hedge* hedge, set<Hedge*>(oldpoint->edges))
-        midpoint->PullHedge(hedge, oldpoint);
-
-    if (e00) DEBUG_ASSERT(midpoint->edges.find(e00) == midpoint->edges.end());
-    if (e01) DEBUG_ASSERT(midpoint->edges.find(e01) == midpoint->edges.end());
-    if (e02) DEBUG_ASSERT(midpoint->edges.find(e02) == midpoint->edges.end());
-    if (e10) DEBUG_ASSERT(midpoint->edges.find(e10) == midpoint->edges.end());
-    if (e11) DEBUG_ASSERT(midpoint->edges.find(e11) == midpoint->edges.end());
-    if (e12) DEBUG_ASSERT(midpoint->edges.find(e12) == midpoint->edges.end());
-
-    if (e00) DEBUG_ASSERT(oldpoint->edges.find(e00) == oldpoint->edges.end());
-    if (e01) DEBUG_ASSERT(oldpoint->edges.find(e01) == oldpoint->edges.end());
-    if (e02) DEBUG_ASSERT(oldpoint->edges.find(e02) == oldpoint->edges.end());
-    if (e10) DEBUG_ASSERT(oldpoint->edges.find(e10) == oldpoint->edges.end());
-    if (e11) DEBUG_ASSERT(oldpoint->edges.find(e11) == oldpoint->edges.end());
-    if (e12) DEBUG_ASSERT(oldpoint->edges.find(e12) == oldpoint->edges.end());
-
-    if (vA && e00) DEBUG_ASSERT(vA->edges.find(e00) == vA->edges.end());
-    if (vA && e01) DEBUG_ASSERT(vA->edges.find(e01) == vA->edges.end());
-    if (vA && e02) DEBUG_ASSERT(vA->edges.find(e02) == vA->edges.end());
-    if (vA && e10) DEBUG_ASSERT(vA->edges.find(e10) == vA->edges.end());
-    if (vA && e11) DEBUG_ASSERT(vA->edges.find(e11) == vA->edges.end());
-    if (vA && e12) DEBUG_ASSERT(vA->edges.find(e12) == vA->edges.end());
-
-    if (vB && e00) DEBUG_ASSERT(vB->edges.find(e00) == vB->edges.end());
-    if (vB && e01) DEBUG_ASSERT(vB->edges.find(e01) == vB->edges.end());
-    if (vB && e02) DEBUG_ASSERT(vB->edges.find(e02) == vB->edges.end());
-    if (vB && e10) DEBUG_ASSERT(vB->edges.find(e10) == vB->edges.end());
-    if (vB && e11) DEBUG_ASSERT(vB->edges.find(e11) == vB->edges.end());
-    if (vB && e12) DEBUG_ASSERT(vB->edges.find(e12) == vB->edges.end());
+    midpoint->edge = mp_edge;
+    oldpoint->edge = NULL;
+    if (vA) vA->edge = va_edge;
+    if (vB) vB->edge = vb_edge;
 
     // clean up isolated verts
-            delete_mp = (midpoint->edges.size() == 0);
-    if (vA) delete_va = (vA->edges.size() == 0);
-    if (vB) delete_vb = (vB->edges.size() == 0);
+    bool delete_mp = (mp_edge == NULL),
+         delete_va = (vA && va_edge == NULL),
+         delete_vb = (vB && vb_edge == NULL);
 
     // remove geom from f/v/e sets
+    reindex = true;
     if (f0) faces.erase(f0);
     if (f1) faces.erase(f1);
 
-    if (e00) { hedges.erase(e00); if (g_qem) queue.erase(e00->handle); }
-    if (e01) { hedges.erase(e01); if (g_qem) queue.erase(e01->handle); }
-    if (e02) { hedges.erase(e02); if (g_qem) queue.erase(e02->handle); }
-    if (e10) { hedges.erase(e10); if (g_qem) queue.erase(e10->handle); }
-    if (e11) { hedges.erase(e11); if (g_qem) queue.erase(e11->handle); }
-    if (e12) { hedges.erase(e12); if (g_qem) queue.erase(e12->handle); }
+    if (e00) { hedges.erase(e00); queue.Remove(e00); }
+    if (e01) { hedges.erase(e01); queue.Remove(e01); }
+    if (e02) { hedges.erase(e02); queue.Remove(e02); }
+    if (e10) { hedges.erase(e10); queue.Remove(e10); }
+    if (e11) { hedges.erase(e11); queue.Remove(e11); }
+    if (e12) { hedges.erase(e12); queue.Remove(e12); }
 
                    vertices.erase(oldpoint);
     if (delete_mp) vertices.erase(midpoint);
     if (delete_va) vertices.erase(vA);
     if (delete_vb) vertices.erase(vB);
+}
 
-    /* collapse fins */
-    if (e02->pair && e02->pair->IsDegenerate()) {
-        printf("degen vA\n");
-        vec3 &p = e02->pair->v->dstval;
-        vec4 newloc = vec4(p.x, p.y, p.z, 1.0);
-        state->degenA = this->Collapse(e02->pair, newloc);
+/* Update quadrics and edge costs after v's fan changed shape. While
+ * Seek is deferring, just note v for RefreshDeferred. */
+void
+Object::Refresh(Vertex *v) {
+    if (deferring) {
+        deferred.push_back(v);
+        return;
     }
-    if (e12 && e12->pair && e12->pair->IsDegenerate()) {
-        printf("degen vB\n");
-        vec3 &p = e12->pair->v->dstval;
-        vec4 newloc = vec4(p.x, p.y, p.z, 1.0);
-        state->degenB = this->Collapse(e12->pair, newloc);
+    v->UpdateQ();
+    foreach(Hedge* h, v->Hedges()) {
+        h->oppv()->UpdateQ();
+        h->prev()->v->UpdateQ();
     }
+    RequeueFan(v);
+    if (queue.nparked() > 0) {
+        foreach(Hedge* h, v->Hedges()) {
+            Unpark(h->oppv());
+            if (h->prev()->pair == NULL)
+                Unpark(h->prev()->v); // the end of an open fan
+        }
+    }
+    Touch(v);
+}
 
-    /* update quadrics */
-    midpoint->UpdateQ();
-    foreach(Vertex* neighbor, midpoint->Vertices())
-      neighbor->UpdateQ();
-
-    /* rebalance heap */
-    foreach(Hedge* h, midpoint->edges) {
-        queue.update(h->handle, h);
-        queue.update(h->next->handle, h->next);
-        queue.update(h->next->next->handle, h->next->next);
+/* Do the work of every Refresh deferred by a Seek, once per vertex. If
+ * much of the mesh changed, the queue is rebuilt rather than patched. */
+void
+Object::RefreshDeferred() {
+    set<Vertex*> changed; // whose quadrics depend on a deferred fan
+    foreach(Vertex *v, deferred) {
+        if (v->edge == NULL || !vertices.count(v))
+            continue; // collapsed away later in the batch
+        changed.insert(v);
+        foreach(Hedge* h, v->Hedges()) {
+            changed.insert(h->oppv());
+            changed.insert(h->prev()->v);
+        }
     }
 
-    DEBUG_ASSERT( this->check() );
+    foreach(Vertex *v, changed)
+        v->UpdateQ();
 
-    return state;
-}
+    if (4 * changed.size() > vertices.size()) {
+        Rescore();
+    } else {
+        requeued.clear();
+        foreach(Vertex *v, changed)
+            foreach(Hedge* h, v->Hedges())
+                requeued.push_back(h);
+        engine->Requeue(this, requeued);
+        foreach(Vertex *v, changed)
+            Unpark(v);
+    }
 
-set<Vertex*>
-Vertex::Vertices() {
-    Hedge *e;
-    set<Vertex*> neighbors;
+    foreach(Vertex *v, deferred)
+        if (v->edge != NULL && vertices.count(v))
+            Touch(v);
+    deferred.clear();
+}
 
-    foreach(Hedge* h, edges) {
-        assert(h->v == this);
-        neighbors.insert(h->oppv());
-        neighbors.insert(h->prev()->v);
+/* Mark v and its neighbours, whose normals follow v, for upload. */
+void
+Object::Touch(Vertex *v) {
+    if (!v->dirty) {
+        v->dirty = true;
+        dirty.push_back(v);
+    }
+    if (v->edge == NULL)
+        return;
+    foreach(Hedge* h, v->Hedges()) {
+        Vertex *n[2] = { h->oppv(), h->prev()->v };
+        for (int i = 0; i < 2; i++) {
+            if (!n[i]->dirty) {
+                n[i]->dirty = true;
+                dirty.push_back(n[i]);
+            }
+        }
     }
-
-    return neighbors;
 }
 
 void
@@ -572,23 +874,22 @@ VertexSplit::Apply(Object* o) {
     if (e00) DEBUG_ASSERT(e00->pair == e10);
     if (e10) DEBUG_ASSERT(e10->pair == e00);
 
-    /* fix hedge->vertex pointers */
-    foreach(Hedge* h, newpointHedges)
-        newpoint->PullHedge(h);
+    /* fix hedge->vertex pointers; the target's hedges never left it */
+    newpoint->edge = e01;
+    foreach(Hedge* h, newpoint->Hedges())
+        h->v = newpoint;
 
-    foreach(Hedge* h, targetHedges)
-        target->PullHedge(h);
-
-    if (vA) vA->PullHedge(e02);
-    if (vB) vB->PullHedge(e12);
+    target->edge = e00;
+    if (vA) vA->edge = e02;
+    if (vB) vB->edge = e12;
 
     /* register primitives with Object */
-    if (e00) { o->hedges.insert(e00); if (g_qem) e00->handle = o->queue.push(e00); }
-    if (e01) { o->hedges.insert(e01); if (g_qem) e01->handle = o->queue.push(e01); }
-    if (e02) { o->hedges.insert(e02); if (g_qem) e02->handle = o->queue.push(e02); }
-    if (e10) { o->hedges.insert(e10); if (g_qem) e10->handle = o->queue.push(e10); }
-    if (e11) { o->hedges.insert(e11); if (g_qem) e11->handle = o->queue.push(e11); }
-    if (e12) { o->hedges.insert(e12); if (g_qem) e12->handle = o->queue.push(e12); }
+    if (e00) o->hedges.insert(e00);
+    if (e01) o->hedges.insert(e01);
+    if (e02) o->hedges.insert(e02);
+    if (e10) o->hedges.insert(e10);
+    if (e11) o->hedges.insert(e11);
+    if (e12) o->hedges.insert(e12);
 
     o->faces.insert(f0);
     if (f1) o->faces.insert(f1);
@@ -601,7 +902,24 @@ VertexSplit::Apply(Object* o) {
     /* make new vertices enter smoothly */
     newpoint->MoveFrom(target->Position());
 
-    DEBUG_ASSERT( o->check() );
+    /* both halves changed shape, so rescore everything around them */
+    o->Refresh(target);
+    o->Refresh(newpoint);
+    o->reindex = true;
+
+    DEBUG_ASSERT( o->checkOp(target) && o->check(newpoint) );
+}
+
+/* Collapse again exactly as recorded, fins included. Only valid when the
+ * mesh around the split is as Apply left it. */
+void
+VertexSplit::Redo(Object* o) {
+    o->Contract(this, vec4(collapse_loc.x, collapse_loc.y, collapse_loc.z, 1.0));
+    if (degenA) degenA->Redo(o);
+    if (degenB) degenB->Redo(o);
+    o->Refresh(target);
+
+    DEBUG_ASSERT( o->checkOp(target) );
 }
 
 VertexSplit::VertexSplit(Hedge *e00)
@@ -623,9 +941,6 @@ VertexSplit::VertexSplit(Hedge *e00)
     target_loc = target->dstval;
     newpoint = e00->oppv();
 
-    targetHedges = target->edges;
-    newpointHedges = newpoint->edges;
-
     vA = (e02) ? e02->v : NULL;
     vB = (e12) ? e12->v : NULL;
 }
@@ -651,25 +966,141 @@ Hedge::IsDegenerate() {
     return v0->dstval == v1->dstval;;
 }
 
+static bool
+adjacent(Vertex *v, Vertex *n) {
+    foreach(Hedge *h, v->Hedges())
+        if (h->oppv() == n || h->prev()->v == n)
+            return true;
+    return false;
+}
+
+bool
+Vertex::IsBoundary() {
+    foreach(Hedge *h, Hedges())
+        if (h->pair == NULL || h->prev()->pair == NULL)
+            return true;
+    return false;
+}
+
+/*
+ * Collapsing must leave every vertex with a single fan, so the endpoints
+ * may only share the neighbours opposite the edge, and an interior edge
+ * can't join two boundary vertices.
+ */
+bool
+Hedge::IsCollapsible() {
+    Vertex *a = v,
+           *b = oppv(),
+           *va = prev()->v,
+           *vb = (pair) ? pair->prev()->v : NULL;
+
+    if (va == vb || a->locked || b->locked)
+        return false;
+    if (pair && a->IsBoundary() && b->IsBoundary())
+        return false;
+    if (pair && !a->IsBoundary() && !b->IsBoundary() &&
+            a->valence() + b->valence() - 4 < 3)
+        return false; // would pinch to a valence-2 vertex, like a tetrahedron's edges
+
+    foreach(Hedge *h, a->Hedges()) {
+        Vertex *n[2] = { h->oppv(), h->prev()->v };
+        for (int i = 0; i < 2; i++)
+            if (n[i] != b && n[i] != va && n[i] != vb && adjacent(b, n[i]))
+                return false;
+    }
+    return true;
+}
+
 void
 Object::Pop(bool many) {
-    int npops = (many) ? std::min(100, (int) (0.1f * (float) faces.size())) : 1;
+    int npops = (many) ? std::max(1, std::min(100, (int) (0.1f * (float) faces.size()))) : 1;
     npops = std::min(npops, (int) faces.size() - 2);
-    for(int i = 0; i < npops; i++)
-        vsplits.push_back(this->CollapseNext());
+    for(int i = 0; i < npops; i++) {
+        VertexSplit *vs = this->CollapseNext();
+        if (vs == NULL)
+            break;
+        vsplits.push_back(vs);
+    }
+}
+
+/* Collapse until there are at most nfaces faces or nothing is left that
+ * can be collapsed. Returns the number of collapses. */
+int
+Object::Simplify(int nfaces) {
+    int ncollapses = 0;
+    while ((int) faces.size() > nfaces) {
+        VertexSplit *vs = this->CollapseNext();
+        if (vs == NULL)
+            break;
+        vsplits.push_back(vs);
+        ncollapses++;
+    }
+    return ncollapses;
+}
+
+/*
+ * Get to about nfaces faces in one go: split back through the recorded
+ * collapses, or redo splits an earlier Seek undid, then collapse afresh
+ * if that's not enough. Quadrics, costs and normals are brought up to
+ * date once at the end instead of after every step.
+ */
+int
+Object::Seek(int nfaces) {
+    int nops = 0;
+    deferring = true;
+    while ((int) faces.size() < nfaces && !vsplits.empty()) {
+        VertexSplit *vs = vsplits.back();
+        vsplits.pop_back();
+        vs->Apply(this);
+        redo.push_back(vs);
+        nops++;
+    }
+    while ((int) faces.size() > nfaces && !redo.empty()) {
+        VertexSplit *vs = redo.back();
+        redo.pop_back();
+        vs->Redo(this);
+        vsplits.push_back(vs);
+        nops++;
+    }
+    deferring = false;
+    RefreshDeferred();
+    DEBUG_ASSERT( this->check() ); // the queue holds again only now
+
+    return nops + Simplify(nfaces);
+}
+
+/* Forget the splits Seek could redo; any other change invalidates them. */
+void
+Object::DropRedo() {
+    foreach(VertexSplit *vs, redo)
+        FreeSplit(vs);
+    redo.clear();
 }
 
 void
 Object::Split(bool many) {
-    int nsplits = (many) ? std::min(100, (int) (0.1f * (float) vsplits.size())) : 1;
+    DropRedo();
+    int nsplits = (many) ? std::max(1, std::min(100, (int) (0.1f * (float) vsplits.size()))) : 1;
     nsplits = std::min(nsplits, (int) vsplits.size());
     for(int i = 0; i < nsplits; i++) {
         vsplits.back()->Apply(this);
-        delete vsplits.back();
+        FreeSplit(vsplits.back());
         vsplits.pop_back();
     }
 }
 
+/* Split records are the only thing a round trip frees: the faces, hedges
+ * and vertices a collapse removes are held by its record and put back by
+ * Apply, so they stay allocated until the Object goes away. */
+void
+Object::FreeSplit(VertexSplit *vs) {
+    if (vs == NULL)
+        return;
+    FreeSplit(vs->degenA);
+    FreeSplit(vs->degenB);
+    splitPool.Free(vs);
+}
+
 void
 Vertex::MoveTo(vec4 p) {
     MoveTo( vec3(p.x, p.y, p.z) );
@@ -679,101 +1110,74 @@ void
 Vertex::MoveTo(vec3 dval) {
     srcval = Position();
     dstval = dval;
-    framesleft = N_FRAMES_PER_SPLIT;
+    morphstart = MorphClock();
+}
+
+/* How far along the morph is, as the shader sees it. */
+float
+Vertex::Blend(double now) {
+    return std::min(1.0, std::max(0.0, (now - morphstart) / MORPH_SECONDS));
 }
 
 glm::vec3
 Vertex::Position() {
-    return dstval + (srcval-dstval) * vec3((float)framesleft/ (float)N_FRAMES_PER_SPLIT);
+    return mix(srcval, dstval, Blend(MorphClock()));
 }
 
 void
 Vertex::MoveFrom(vec3 sval) {
     srcval = sval;
-    framesleft = N_FRAMES_PER_SPLIT;
+    morphstart = MorphClock();
 }
 
-
+/* Restart the morph from wherever the vertex is drawn now, heading for
+ * its final position and the normal its faces will have there. */
 void
-Vertex::UpdateQ() {
-    Q = mat4(0.0);
-    foreach(Hedge* h, edges) {
-        Face* face = h->f;
-        vec3 norm = face->Normal();
-        vec3 pos = dstval;
-        vec3 dv = pos * norm; // element-wise
-        vec4 p(norm.x, norm.y, norm.z, 0.0 - dv.x - dv.y - dv.z); /* = [a b c d] */
-        Q += outerProduct(p, p);
-    }
+Vertex::Retarget(double now) {
+    float t = Blend(now);
+    srcval = mix(srcval, dstval, t);
+    srcnorm = mix(srcnorm, dstnorm, t);
+    if (edge != NULL)
+        dstnorm = Normal();
+    morphstart = now;
 }
 
-bool
-QEMCompare::operator() (Hedge *x, Hedge* y) const {
-    /* min-cost hedge should be on top, but heap is a max heap so this is
-     * the opposite of what you'd expect */
-    double x_error = x->GetError(),
-           y_error = y->GetError();
+double
+MorphClock() {
+    return Now();
+}
 
-    /* reject nans */
-    if (g_qem) {
-        assert(x_error == x_error);
-        assert(y_error == y_error);
-    }
 
-    return x_error > y_error;
+void
+Vertex::UpdateQ() {
+    Q = Quadric();
+    foreach(Hedge* h, Hedges())
+        Q += h->f->GetQ();
 }
 
-double
-Hedge::GetError() {
-    mat4 Q = GetQ();
-    vec4 v_bar = GetVBar();
-    vec4 Qdotv = Q * v_bar;
-    return dot(v_bar, Qdotv);
+/* Squared distance to this face's plane. */
+Quadric
+Face::GetQ() {
+    Quadric Q;
+    vec3 norm = Normal();
+    if (norm != norm)
+        return Q; // zero-area face, no plane to contribute
+    vec3 pos = edge->v->dstval;
+    double d = 0.0 - (double) pos.x * norm.x - (double) pos.y * norm.y - (double) pos.z * norm.z;
+    Q.AddPlane(norm.x, norm.y, norm.z, d); /* = [a b c d] */
+    return Q;
 }
 
-mat4
+Quadric
 Vertex::GetQ() {
-    UpdateQ(); // XXX could cache it
     return Q;
 }
-mat4
+Quadric
 Hedge::GetQ() {
     return v->GetQ() + oppv()->GetQ();
 }
 
-vec4
-Hedge::GetVBar() {
-    mat4 Q = GetQ();
-    Q[0][3] = 0.0;
-    Q[1][3] = 0.0;
-    Q[2][3] = 0.0;
-    Q[3][3] = 1.0;
-
-    if (g_qem and determinant(Q) != 0.0)
-        return glm::column(inverse(Q), 3);
-    else
-        return homogenize( GetMidpoint() );
-}
-
 vec3
 Hedge::GetMidpoint() {
     return vec3(0.5) * (v->dstval + oppv()->dstval);
 }
-
-Hedge*
-Vertex::edge() {
-    return *(edges.begin());
-}
-
-void
-Vertex::PullHedge(Hedge* newInEdge, Vertex *old) {
-    if (old)
-        DEBUG_ASSERT(newInEdge->v == old);
-
-    newInEdge->v->edges.erase(newInEdge);
-    newInEdge->v = this;
-    newInEdge->v->edges.insert(newInEdge);
-
-    if ((long int) newInEdge < 100)
-        assert(false);
-}
@@ -1,57 +1,68 @@
-#include "viewer.h"
+#ifndef _OBJECT_H_
+#define _OBJECT_H_
+
+#include "core.h"
+#include "Pool.h"
+#include "Quadric.h"
+#include "EdgeQueue.h"
 
 #include <set>
-#include <boost/heap/binomial_heap.hpp>
+#include <vector>
+#include <iterator>
+#include <cstdio>
 
 
 class Hedge;
 class Object;
 class VertexSplit;
+class HedgeFan;
+class Engine;
 
-struct QEMCompare : std::binary_function <Hedge*,Hedge*,bool> {
-    bool operator() (Hedge *x, Hedge* y) const;
-};
+/* rough size of the half-edge structure per face, splits included */
+#define BYTES_PER_FACE 896
 
-typedef boost::heap::binomial_heap<
-        Hedge*,
-        boost::heap::compare< QEMCompare >
-    > Heap;
+/* seconds on the clock geomorphs are timed by */
+double MorphClock();
 
 class Vertex {
 public:
     glm::vec3 srcval; // starting location of vertex
     glm::vec3 dstval; // ending location of vertex
-    int framesleft; // number of remaining animation frames
-    std::set<Hedge*> edges;
-    Hedge* edge();
+    glm::vec3 srcnorm, dstnorm; // normal at either end of the morph
+    double morphstart; // MorphClock() when the morph began
+    int index; // slot in the vertex buffer
+    bool dirty; // morph changed since the last upload
+    Hedge* edge; // any hedge leaving this vertex
+    HedgeFan Hedges();
+    int id; // index in the mesh as loaded, after any weld or reorder
+    bool locked; // never collapsed
 
     Vertex(glm::vec3 val);
     int valence();
+    bool IsBoundary();
 
-    bool Render();
     glm::vec3 Normal();
     glm::vec3 CurrentNormal();
     glm::vec3 Position();
-    void DrawNormal();
+    float Blend(double now);
     void MoveTo(glm::vec3 dstval);
     void MoveTo(glm::vec4 dstval);
     void MoveFrom(glm::vec3 dstval);
-    std::set<Vertex*> Vertices();
-    glm::mat4 Q;
+    void Retarget(double now);
+    Quadric Q; // planes of the faces around it; kept current by UpdateQ
     void UpdateQ();
-    glm::mat4 GetQ();
-    void PullHedge(Hedge *newIncidentEdge, Vertex *oldpoint=NULL);
+    Quadric GetQ();
 };
 
 class Face {
 public:
     Hedge* edge;
+    int id; // index in the input mesh
 
     Face();
-    bool Render();
-    void DrawNormal();
     glm::vec3 Normal();
     glm::vec3 CurrentNormal();
+    Quadric GetQ();
 };
 
 class Hedge {
@@ -60,44 +71,157 @@ public:
     Hedge* next;
     Hedge* pair;
     Vertex* v;
-    Heap::handle_type handle;
+    int slot; // position of this edge's entry in the queue, or -1; below if parked
+    unsigned int stamp;
 
     Hedge(Vertex *v, Hedge *next=NULL, Face *f=NULL);
     Hedge* prev();
     Vertex* oppv();
 
     void SetPair(Hedge* o);
-    bool Render();
     bool IsDegenerate();
-    double GetError();
-    glm::vec4 GetVBar();
-    glm::mat4 GetQ();
+    bool IsCollapsible();
+    Quadric GetQ();
     glm::vec3 GetMidpoint();
 };
 
+/*
+ * The hedges leaving a vertex, found by circulating from Vertex::edge.
+ * Walks one way around the vertex with pair->next; if that runs off a
+ * boundary it goes back to the start and walks the other way with
+ * prev()->pair, so open fans are covered too.
+ */
+class HedgeFan {
+public:
+    class iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Hedge* value_type;
+        typedef Hedge* reference;
+        typedef Hedge** pointer;
+        typedef std::ptrdiff_t difference_type;
+
+        iterator(Hedge *start = NULL) : start(start), h(start), backward(false) {}
+
+        Hedge* operator*() const { return h; }
+        bool operator==(const iterator &o) const { return h == o.h; }
+        bool operator!=(const iterator &o) const { return h != o.h; }
+
+        iterator& operator++() {
+            if (!backward) {
+                Hedge *n = (h->pair) ? h->pair->next : NULL;
+                if (n != NULL) {
+                    h = (n == start) ? NULL : n;
+                    return *this;
+                }
+                backward = true;
+                h = start;
+            }
+            h = h->next->next->pair;
+            return *this;
+        }
+
+    private:
+        Hedge *start, *h;
+        bool backward;
+    };
+    typedef iterator const_iterator;
+
+    HedgeFan(Hedge *start) : start(start) {}
+    iterator begin() const { return iterator(start); }
+    iterator end() const { return iterator(); }
+
+private:
+    Hedge *start;
+};
+
+inline HedgeFan
+Vertex::Hedges() {
+    return HedgeFan(edge);
+}
+
+inline Hedge*
+Hedge::prev() {
+    return this->next->next;
+}
+
+inline Vertex*
+Hedge::oppv() {
+    return this->next->v;
+}
+
 class Object {
 public:
+    /* every element of the mesh lives in one of these, including the
+     * ones only referenced by pending vertex splits */
+    Pool<Vertex> vertexPool;
+    Pool<Face> facePool;
+    Pool<Hedge> hedgePool;
+    Pool<VertexSplit> splitPool;
+
     std::set<Face*> faces;
     std::set<Hedge*> hedges;
     std::set<Vertex*> vertices;
     std::vector<VertexSplit*> vsplits;
-
-    Object(FILE* inputfile);
-    bool Render();
-    void DrawNormals(int vNorms, int fNorms);
-    void DrawPoints();
+    std::vector<VertexSplit*> redo; // splits Seek applied, newest last
+
+    /* vertices whose morphs changed since a renderer last took them, and
+     * whether faces changed */
+    std::vector<Vertex*> dirty;
+    bool reindex;
+    double morphend;
+
+    double loadTime, queueTime; // seconds to read and link, and to queue edges
+
+    Object();
+    Object(FILE* inputfile, float weld = -1.0f, bool reorder = false);
+    Object(std::vector<glm::vec3> &verts, std::vector<int> &tris);
+    bool Read(FILE* input, float weld = -1.0f, bool reorder = false);
+    void Clear();
+    void Export(std::vector<glm::vec3> &verts, std::vector<int> &tris, std::vector<int> *ids = NULL);
+    void Write(FILE* output);
+    static void Write(FILE* output, std::vector<glm::vec3> &verts, std::vector<int> &tris);
+    void UpdateMorphs();
+    bool Morphing();
     void SetCenterSize(float *center, float *size);
     VertexSplit* CollapseNext();
     VertexSplit* Collapse(Hedge* e, glm::vec4 newloc);
+    void Contract(VertexSplit* vs, glm::vec4 newloc);
+    void Refresh(Vertex* v);
+    void Touch(Vertex* v);
     Hedge* PeekNext();
+    Hedge* Holder(Hedge* e);
+    void RequeueFan(Vertex* v);
+    void Unpark(Vertex* v);
 
     void Pop(bool many = false);
     void Split(bool many = false);
+    int Simplify(int nfaces);
+    int Seek(int nfaces);
+    void DropRedo();
+    void FreeSplit(VertexSplit *vs);
 
     int check();
+    int check(Vertex *v);
+    int checkOp(Vertex *v);
     void match_pairs();
 
-    Heap queue;
+    EdgeQueue queue;
+    Engine *engine; // places and scores collapses
+    void SetEngine(Engine *e);
+
+private:
+    bool deferring; // Refresh only notes vertices in deferred; check() skips the queue
+    std::vector<Vertex*> deferred;
+    std::vector<Hedge*> requeued; // scratch for one Engine::Requeue
+    int nchecked; // operations checked, for checkOp
+
+    bool checkHedge(Hedge *h);
+    int checkFan(Vertex *v);
+
+    void Build(std::vector<glm::vec3> &verts, std::vector<int> &tris);
+    void Rescore();
+    void RefreshDeferred();
 };
 
 class VertexSplit {
@@ -108,11 +232,14 @@ class VertexSplit {
     Hedge *e00, *e01, *e02, *e10, *e11, *e12;
     Face *f0, *f1;
     glm::vec3 target_loc;
-    std::set<Hedge*> targetHedges, newpointHedges;
+    glm::vec3 collapse_loc; // where the collapse moved the target
 
     VertexSplit(Hedge *e00);
     void Apply(Object* o);
+    void Redo(Object* o);
 
     VertexSplit *degenA;
     VertexSplit *degenB;
 };
+
+#endif /* _OBJECT_H_ */
@@ -0,0 +1,132 @@
+#ifndef _POLICY_H_
+#define _POLICY_H_
+
+#include <vector>
+
+#include "Object.h"
+
+/*
+ * Collapse policies: where an edge collapses to and what that costs.
+ * Each is a struct of static functions so an Engine built on it can
+ * inline the math into its loops.
+ */
+
+/* The point minimizing the summed quadric error of both ends. */
+struct QEMOptimal {
+    static glm::vec4 Place(Hedge *e, const Quadric &Q) {
+        double x, y, z;
+        if (Q.Solve(x, y, z))
+            return glm::vec4(x, y, z, 1.0);
+
+        /* no well-defined minimum; take the best of the ends and the middle */
+        glm::vec3 candidates[3] = { e->v->dstval, e->oppv()->dstval, e->GetMidpoint() };
+        int best = 0;
+        double besterr = 0.0;
+        for (int i = 0; i < 3; i++) {
+            double err = Q.Eval(candidates[i].x, candidates[i].y, candidates[i].z);
+            if (i == 0 || err < besterr) {
+                best = i;
+                besterr = err;
+            }
+        }
+        glm::vec3 p = candidates[best];
+        return glm::vec4(p.x, p.y, p.z, 1.0);
+    }
+
+    static glm::vec4 Place(Hedge *e) {
+        return Place(e, e->GetQ());
+    }
+
+    static double Cost(Hedge *e) {
+        Quadric Q = e->GetQ();
+        glm::vec4 p = Place(e, Q);
+        return Q.Eval(p.x, p.y, p.z);
+    }
+};
+
+/* The midpoint, scored by quadric error there. */
+struct QEMMidpoint {
+    static glm::vec4 Place(Hedge *e) {
+        glm::vec3 p = e->GetMidpoint();
+        return glm::vec4(p.x, p.y, p.z, 1.0);
+    }
+
+    static double Cost(Hedge *e) {
+        glm::vec3 p = e->GetMidpoint();
+        return e->GetQ().Eval(p.x, p.y, p.z);
+    }
+};
+
+/* The midpoint, shortest edges first. */
+struct EdgeLength {
+    static glm::vec4 Place(Hedge *e) {
+        return QEMMidpoint::Place(e);
+    }
+
+    static double Cost(Hedge *e) {
+        glm::vec3 d = e->oppv()->dstval - e->v->dstval;
+        return glm::dot(d, d);
+    }
+};
+
+/*
+ * What an Object simplifies with. The loops that score edges live here, so
+ * switching engines costs one virtual call per collapse or batch of edges
+ * and the policy math inside is inlined.
+ */
+class Engine {
+  public:
+    virtual ~Engine() {}
+    virtual glm::vec4 Place(Hedge *e) = 0;
+    virtual double Cost(Hedge *e) = 0;
+    virtual void Cost(std::vector<Hedge*> &edges, std::vector<double> &costs) = 0;
+    virtual void Requeue(Object *o, std::vector<Hedge*> &edges) = 0;
+    virtual VertexSplit* CollapseNext(Object *o) = 0;
+};
+
+template <class Policy>
+class PolicyEngine : public Engine {
+  public:
+    glm::vec4 Place(Hedge *e) { return Policy::Place(e); }
+    double Cost(Hedge *e) { return Policy::Cost(e); }
+
+    /* costs for many edges at once, in parallel when built with OpenMP */
+    void Cost(std::vector<Hedge*> &edges, std::vector<double> &costs) {
+        costs.resize(edges.size());
+        #pragma omp parallel for
+        for (int i = 0; i < (int) edges.size(); i++)
+            costs[i] = Policy::Cost(edges[i]);
+    }
+
+    /* rescore edges whose ends changed, in o's queue */
+    void Requeue(Object *o, std::vector<Hedge*> &edges) {
+        for (unsigned int i = 0; i < edges.size(); i++) {
+            Hedge *e = o->Holder(edges[i]);
+            o->queue.Update(e, Policy::Cost(e));
+        }
+    }
+
+    VertexSplit* CollapseNext(Object *o) {
+        Hedge *e = o->PeekNext();
+        if (e == NULL)
+            return NULL;
+        return o->Collapse(e, Policy::Place(e));
+    }
+};
+
+enum { QEM_OPTIMAL, QEM_MIDPOINT, EDGE_LENGTH };
+
+/* One shared engine per policy; they hold no state. */
+inline Engine*
+GetEngine(int policy) {
+    static PolicyEngine<QEMOptimal> optimal;
+    static PolicyEngine<QEMMidpoint> midpoint;
+    static PolicyEngine<EdgeLength> length;
+    switch (policy) {
+        case QEM_MIDPOINT: return &midpoint;
+        case EDGE_LENGTH:  return &length;
+        default:           return &optimal;
+    }
+}
+
+#endif /* _POLICY_H_ */
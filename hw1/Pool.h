@@ -0,0 +1,98 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <new>
+#include <vector>
+#include <cassert>
+
+/*
+ * Slab allocator for one kind of mesh element. Storage is carved out of
+ * fixed-size slabs, freed elements go on a free list to be handed out
+ * again, and whatever is still allocated is destroyed along with the pool.
+ * Clear() destroys everything but keeps the slabs, so a pool can be
+ * refilled without going back to the system for memory.
+ *
+ * Alloc() returns raw storage; construct into it with placement new:
+ *
+ *     Hedge *h = new (hedgePool.Alloc()) Hedge(v, next, f);
+ */
+template <class T, int SLAB_SIZE = 4096>
+class Pool {
+  public:
+    Pool() : freelist(NULL), current(-1), used(SLAB_SIZE), nlive(0) {}
+
+    ~Pool() {
+        Clear();
+        for (unsigned int s = 0; s < slabs.size(); s++)
+            delete [] slabs[s];
+    }
+
+    void Clear() {
+        for (int s = 0; s <= current; s++) {
+            int n = (s == current) ? used : SLAB_SIZE;
+            for (int i = 0; i < n; i++) {
+                if (slabs[s][i].live)
+                    ((T*) slabs[s][i].storage)->~T();
+                slabs[s][i].live = false;
+            }
+        }
+        freelist = NULL;
+        current = -1;
+        used = SLAB_SIZE;
+        nlive = 0;
+    }
+
+    void* Alloc() {
+        Slot *slot = freelist;
+        if (slot != NULL) {
+            freelist = slot->next;
+        } else {
+            if (used == SLAB_SIZE) {
+                if (++current == (int) slabs.size())
+                    slabs.push_back(new Slot[SLAB_SIZE]);
+                used = 0;
+            }
+            slot = &slabs[current][used++];
+        }
+        slot->live = true;
+        nlive++;
+        return slot->storage;
+    }
+
+    void Free(T* p) {
+        if (p == NULL)
+            return;
+        Slot *slot = (Slot*) p;
+        assert(slot->live);
+        p->~T();
+        slot->live = false;
+        slot->next = freelist;
+        freelist = slot;
+        nlive--;
+    }
+
+    int size() { return nlive; }
+
+  private:
+    /* storage comes first so a T* is also a Slot* */
+    struct Slot {
+        union {
+            char storage[sizeof(T)];
+            Slot *next;
+            double align_d;
+            void *align_p;
+        };
+        bool live;
+    };
+
+    std::vector<Slot*> slabs;
+    Slot *freelist;
+    int current; // slab fresh slots come from; later ones are spares
+    int used;    // slots handed out from it
+    int nlive;
+
+    Pool(const Pool&);
+    Pool& operator=(const Pool&);
+};
+
+#endif /* _POOL_H_ */
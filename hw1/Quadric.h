@@ -0,0 +1,120 @@
+#ifndef _QUADRIC_H_
+#define _QUADRIC_H_
+
+#include <cmath>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+/* a quadric much worse conditioned than this has no sure minimum */
+#define MAX_CONDITION 1e7
+
+/*
+ * Symmetric 4x4 error quadric, in double precision. Only the upper
+ * triangle is stored:
+ *
+ *     | q0 q1 q2 q3 |
+ *     |    q4 q5 q6 |
+ *     |       q7 q8 |
+ *     |          q9 |
+ *
+ * With AVX (make AVX=1, or -march=native) adding and evaluating go four
+ * coefficients at a time; otherwise they're plain loops.
+ */
+class Quadric {
+  public:
+    Quadric() {
+        for (int i = 0; i < 10; i++)
+            q[i] = 0.0;
+    }
+
+    /* Add the squared distance to the plane ax + by + cz + d = 0. */
+    void AddPlane(double a, double b, double c, double d) {
+#ifdef __AVX__
+        __m256d p = _mm256_set_pd(d, c, b, a);
+        _mm256_storeu_pd(q, _mm256_add_pd(_mm256_loadu_pd(q),
+                _mm256_mul_pd(_mm256_set1_pd(a), p)));
+        _mm256_storeu_pd(q + 4, _mm256_add_pd(_mm256_loadu_pd(q + 4),
+                _mm256_mul_pd(_mm256_set_pd(c, b, b, b), _mm256_set_pd(c, d, c, b))));
+#else
+        q[0] += a*a; q[1] += a*b; q[2] += a*c; q[3] += a*d;
+        q[4] += b*b; q[5] += b*c; q[6] += b*d; q[7] += c*c;
+#endif
+        q[8] += c*d; q[9] += d*d;
+    }
+
+    Quadric& operator+=(const Quadric &o) {
+#ifdef __AVX__
+        _mm256_storeu_pd(q, _mm256_add_pd(_mm256_loadu_pd(q), _mm256_loadu_pd(o.q)));
+        _mm256_storeu_pd(q + 4, _mm256_add_pd(_mm256_loadu_pd(q + 4), _mm256_loadu_pd(o.q + 4)));
+        q[8] += o.q[8]; q[9] += o.q[9];
+#else
+        for (int i = 0; i < 10; i++)
+            q[i] += o.q[i];
+#endif
+        return *this;
+    }
+
+    Quadric operator+(const Quadric &o) const {
+        Quadric sum(*this);
+        return sum += o;
+    }
+
+    /* v^T Q v for v = (x, y, z, 1) */
+    double Eval(double x, double y, double z) const {
+#ifdef __AVX__
+        __m256d s = _mm256_add_pd(
+                _mm256_mul_pd(_mm256_loadu_pd(q), _mm256_mul_pd(
+                        _mm256_set_pd(2*x, 2*x, 2*x, x), _mm256_set_pd(1.0, z, y, x))),
+                _mm256_mul_pd(_mm256_loadu_pd(q + 4), _mm256_mul_pd(
+                        _mm256_set_pd(z, 2*y, 2*y, y), _mm256_set_pd(z, 1.0, z, y))));
+        __m128d h = _mm_add_pd(_mm256_castpd256_pd128(s), _mm256_extractf128_pd(s, 1));
+        double sum = _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+#else
+        double sum = q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x
+                   + q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y + q[7]*z*z;
+#endif
+        return sum + 2*q[8]*z + q[9];
+    }
+
+    /*
+     * Find the point minimizing the error by solving the 3x3 system
+     * from the gradient in closed form. Returns false, leaving x, y and z
+     * alone, if the system is too close to singular for that point to
+     * mean much (all the planes nearly parallel, or meeting in a line).
+     */
+    bool Solve(double &x, double &y, double &z) const {
+        /* cofactors of the upper-left 3x3, which is also symmetric */
+        double c00 = q[4]*q[7] - q[5]*q[5],
+               c01 = q[2]*q[5] - q[1]*q[7],
+               c02 = q[1]*q[5] - q[2]*q[4],
+               c11 = q[0]*q[7] - q[2]*q[2],
+               c12 = q[1]*q[2] - q[0]*q[5],
+               c22 = q[0]*q[4] - q[1]*q[1];
+        double det = q[0]*c00 + q[1]*c01 + q[2]*c02;
+
+        /* |A| |A^-1| in the Frobenius norm, with A^-1 = adj(A) / det */
+        double a2 = q[0]*q[0] + q[4]*q[4] + q[7]*q[7]
+                  + 2*(q[1]*q[1] + q[2]*q[2] + q[5]*q[5]),
+               adj2 = c00*c00 + c11*c11 + c22*c22
+                    + 2*(c01*c01 + c02*c02 + c12*c12);
+        if (!(std::sqrt(a2 * adj2) < MAX_CONDITION * std::fabs(det)))
+            return false;
+
+        double bx = -q[3], by = -q[6], bz = -q[8];
+        double sx = (c00*bx + c01*by + c02*bz) / det,
+               sy = (c01*bx + c11*by + c12*bz) / det,
+               sz = (c02*bx + c12*by + c22*bz) / det;
+        if (!std::isfinite(sx) || !std::isfinite(sy) || !std::isfinite(sz))
+            return false;
+
+        x = sx; y = sy; z = sz;
+        return true;
+    }
+
+  private:
+    double q[10];
+};
+
+#endif /* _QUADRIC_H_ */
@@ -0,0 +1,248 @@
+#include "Simplifier.h"
+#include "Object.h"
+#include "Policy.h"
+#include "VertexHierarchy.h"
+#include "timer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <sys/time.h>
+
+using namespace std;
+
+/* how often the thread wakes to animate or refine when nothing is posted */
+#define TICK_SECONDS (1.0 / 120)
+
+Simplifier::Simplifier(Object *o)
+    : o(o), hierarchy(NULL), animate(false), direction(0),
+      stopping(false), stopped(false), serial(0), topology(0), epoch(MorphClock()) {
+    held[0] = held[1] = held[2] = -1;
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&posted, NULL);
+
+    view.modelview = glm::mat4(1.0f);
+    view.fovy = 45.0f;
+    view.aspect = 1.0f;
+    view.height = 1;
+    view.tolerance = 1.0f;
+
+    /* something to draw before the thread gets going */
+    o->UpdateMorphs();
+    Publish();
+
+    if (pthread_create(&thread, NULL, Run, this) != 0) {
+        fprintf(stderr, "Unable to start simplifier thread\n");
+        exit(2);
+    }
+}
+
+Simplifier::~Simplifier() {
+    Stop();
+    delete hierarchy;
+    pthread_mutex_destroy(&lock);
+    pthread_cond_destroy(&posted);
+}
+
+void
+Simplifier::Stop() {
+    if (stopped)
+        return;
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_signal(&posted);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+    stopped = true;
+}
+
+void
+Simplifier::Post(Command command, int arg) {
+    Request r = { command, arg };
+    pthread_mutex_lock(&lock);
+    requests.push_back(r);
+    pthread_cond_signal(&posted);
+    pthread_mutex_unlock(&lock);
+}
+
+void
+Simplifier::SetView(const glm::mat4 &modelview, float fovy, float aspect,
+        int height, float tolerance) {
+    pthread_mutex_lock(&lock);
+    view.modelview = modelview;
+    view.fovy = fovy;
+    view.aspect = aspect;
+    view.height = height;
+    view.tolerance = tolerance;
+    pthread_mutex_unlock(&lock);
+}
+
+void*
+Simplifier::Run(void *arg) {
+    ((Simplifier*) arg)->Loop();
+    return NULL;
+}
+
+void
+Simplifier::Loop() {
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        while (requests.empty() && !stopping) {
+            if (!animate && hierarchy == NULL) {
+                pthread_cond_wait(&posted, &lock);
+                continue;
+            }
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            long usec = now.tv_usec + (long) (1e6 * TICK_SECONDS);
+            struct timespec until = { now.tv_sec + usec / 1000000, 1000 * (usec % 1000000) };
+            pthread_cond_timedwait(&posted, &lock, &until);
+            break;
+        }
+        if (stopping && requests.empty()) {
+            pthread_mutex_unlock(&lock);
+            return;
+        }
+        deque<Request> todo;
+        todo.swap(requests);
+        View v = view;
+        pthread_mutex_unlock(&lock);
+
+        for (unsigned int i = 0; i < todo.size(); i++) {
+            double start = Now();
+            Apply(todo[i]);
+            commandTimes.push_back(Now() - start);
+        }
+        Step(v);
+
+        if (!todo.empty() || !o->dirty.empty() || o->reindex) {
+            double start = Now();
+            o->UpdateMorphs();
+            Publish();
+            publishTimes.push_back(Now() - start);
+        }
+    }
+}
+
+void
+Simplifier::Apply(Request &r) {
+    switch (r.command) {
+        case POP:
+        case POP_MANY:
+            if (!hierarchy) o->Pop(/* many = */ r.command == POP_MANY);
+            break;
+        case SPLIT:
+        case SPLIT_MANY:
+            if (!hierarchy) o->Split(/* many = */ r.command == SPLIT_MANY);
+            break;
+        case SEEK:
+            if (!hierarchy) o->Seek(r.arg);
+            break;
+        case ENGINE:
+            o->SetEngine(GetEngine(r.arg));
+            break;
+        case ANIMATE:
+            animate = r.arg;
+            break;
+        case REFINE:
+            if (r.arg && hierarchy == NULL) {
+                hierarchy = new VertexHierarchy(o);
+            } else if (!r.arg && hierarchy != NULL) {
+                delete hierarchy;
+                hierarchy = NULL;
+            }
+            break;
+    }
+}
+
+/* What happens every tick whether or not anything was posted. */
+void
+Simplifier::Step(View &v) {
+    if (hierarchy) {
+        hierarchy->Adapt(v.modelview, v.fovy, v.aspect, v.height, v.tolerance);
+    }
+
+    /* pop until few edges are left, then split back, one morph at a time */
+    else if (animate && !o->Morphing()) {
+        if (o->vsplits.size() == 0)
+            direction = 0;
+        else if (o->queue.size() <= 8)
+            direction = 1;
+
+        if (direction)
+            o->Split();
+        else
+            o->Pop();
+    }
+}
+
+/* Bring the snapshot up to date with the Object and hand it over. */
+void
+Simplifier::Publish() {
+    if (o->reindex) {
+        indices.clear();
+        foreach(Face *f, o->faces) {
+            indices.push_back(f->edge->v->index);
+            indices.push_back(f->edge->next->v->index);
+            indices.push_back(f->edge->next->next->v->index);
+        }
+        live.clear();
+        foreach(Vertex *v, o->vertices)
+            live.push_back(v->index);
+        topology++;
+        o->reindex = false;
+    }
+
+    if ((int) slots.size() < o->vertexPool.size())
+        slots.resize(o->vertexPool.size());
+    foreach(Vertex *v, o->dirty) {
+        Snapshot::Slot &s = slots[v->index];
+        for (int k = 0; k < 3; k++) {
+            s.srcpos[k] = v->srcval[k];
+            s.dstpos[k] = v->dstval[k];
+            s.srcnorm[k] = v->srcnorm[k];
+            s.dstnorm[k] = v->dstnorm[k];
+        }
+        s.start = v->morphstart - epoch;
+        v->dirty = false;
+        changes.push_back(make_pair(serial, (unsigned int) v->index));
+    }
+    o->dirty.clear();
+
+    /* the back snapshot is some way behind; copy only the slots changed
+     * since the oldest snapshot in any buffer, which covers both it and
+     * whatever the reader has, and the indices if they moved */
+    Snapshot &s = snapshots.Back();
+    s.since = *min_element(held, held + 3);
+    s.dirty.clear();
+    deque<pair<int, unsigned int> >::iterator it =
+        lower_bound(changes.begin(), changes.end(), make_pair(s.since + 1, 0u));
+    for (; it != changes.end(); ++it)
+        s.dirty.push_back(it->second);
+    sort(s.dirty.begin(), s.dirty.end());
+    s.dirty.erase(unique(s.dirty.begin(), s.dirty.end()), s.dirty.end());
+
+    s.slots.resize(slots.size());
+    foreach(unsigned int i, s.dirty)
+        s.slots[i] = slots[i];
+    if (s.topology != topology) {
+        s.indices = indices;
+        s.live = live;
+        s.topology = topology;
+    }
+    s.epoch = epoch;
+    s.nvertices = o->vertices.size();
+    s.nfaces = o->faces.size();
+    s.ncollapsed = (hierarchy) ? hierarchy->collapsed() : o->vsplits.size();
+    s.refining = (hierarchy != NULL);
+
+    /* nothing needs changes from before the oldest snapshot still held */
+    int filled = s.serial;
+    s.serial = serial++;
+    *find(held, held + 3, filled) = s.serial;
+    int oldest = *min_element(held, held + 3);
+    while (!changes.empty() && changes.front().first <= oldest)
+        changes.pop_front();
+
+    snapshots.Publish();
+}
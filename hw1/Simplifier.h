@@ -0,0 +1,122 @@
+#ifndef _SIMPLIFIER_H_
+#define _SIMPLIFIER_H_
+
+#include <deque>
+#include <vector>
+#include <pthread.h>
+
+#include "core.h"
+#include "TripleBuffer.h"
+
+class Object;
+class VertexHierarchy;
+
+/*
+ * Takes over an Object and runs everything that changes it on a thread of
+ * its own, so drawing never waits on a collapse. Other threads Post commands
+ * and the camera; the thread carries them out, keeps the morphs current
+ * and publishes a Snapshot whenever what's drawn changes. Nothing else
+ * may touch the Object until the Simplifier is gone.
+ */
+class Simplifier {
+  public:
+    /*
+     * Everything a renderer needs to draw an Object at one moment, copied
+     * out of it so the Object can go on changing on another thread.
+     */
+    struct Snapshot {
+        /* one vertex's geomorph, as the vertex shader takes it */
+        struct Slot {
+            float srcpos[3], dstpos[3];
+            float srcnorm[3], dstnorm[3];
+            float start; // seconds after epoch
+        };
+
+        std::vector<Slot> slots;            // by Vertex::index
+        std::vector<unsigned int> dirty;    // slots changed since serial `since`, sorted
+        std::vector<unsigned int> indices;  // three slots per face
+        std::vector<unsigned int> live;     // slots of the vertices in the mesh
+        int serial;     // counts up with every snapshot published
+        int since;      // slots differ from snapshot since's only in dirty
+        int topology;   // counts up whenever indices and live change
+        double epoch;   // MorphClock() that slot starts count from
+
+        int nvertices, nfaces, ncollapsed;
+        bool refining;
+
+        Snapshot() : serial(-1), since(-1), topology(-1), epoch(0.0),
+            nvertices(0), nfaces(0), ncollapsed(0), refining(false) {}
+    };
+
+    enum Command {
+        POP, POP_MANY, SPLIT, SPLIT_MANY,
+        SEEK,    // arg: faces
+        ENGINE,  // arg: policy, as for GetEngine
+        ANIMATE, // arg: on or off
+        REFINE   // arg: on or off
+    };
+
+    Simplifier(Object *o);
+    ~Simplifier();
+
+    /* finish what was posted and end the thread */
+    void Stop();
+
+    void Post(Command command, int arg = 0);
+    void SetView(const glm::mat4 &modelview, float fovy, float aspect,
+            int height, float tolerance);
+
+    /* the latest snapshot; Update() first to pick up a newer one */
+    bool Update() { return snapshots.Update(); }
+    const Snapshot& Latest() { return snapshots.Front(); }
+
+    /* seconds each command took, and each snapshot; safe once stopped */
+    std::vector<double> commandTimes, publishTimes;
+
+  private:
+    struct Request {
+        Command command;
+        int arg;
+    };
+    struct View {
+        glm::mat4 modelview;
+        float fovy, aspect, tolerance;
+        int height;
+    };
+
+    Object *o;
+    VertexHierarchy *hierarchy;
+    bool animate;
+    int direction; // of the animation; 1: splits  0: pops
+
+    /* shared with posting threads, under lock */
+    pthread_mutex_t lock;
+    pthread_cond_t posted;
+    std::deque<Request> requests;
+    View view;
+    bool stopping, stopped;
+
+    /* the snapshot as of now, kept up to date one dirty vertex at a time */
+    pthread_t thread;
+    TripleBuffer<Snapshot> snapshots;
+    std::vector<Snapshot::Slot> slots;
+    std::vector<unsigned int> indices, live;
+    int serial, topology;
+    double epoch;
+
+    /* (serial, slot) for every slot each snapshot changed, oldest first,
+     * back to the oldest snapshot still in one of the buffers */
+    std::deque<std::pair<int, unsigned int> > changes;
+    int held[3]; // serials of the snapshots in the buffers
+
+    static void* Run(void *arg);
+    void Loop();
+    void Apply(Request &r);
+    void Step(View &v);
+    void Publish();
+
+    Simplifier(const Simplifier&);
+    Simplifier& operator=(const Simplifier&);
+};
+
+#endif /* _SIMPLIFIER_H_ */
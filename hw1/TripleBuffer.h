@@ -0,0 +1,55 @@
+#ifndef _TRIPLEBUFFER_H_
+#define _TRIPLEBUFFER_H_
+
+/*
+ * Hands the latest of a stream of Ts from one writer thread to one reader
+ * thread without either ever waiting on the other.
+ *
+ * There are three Ts. The writer fills its back one and swaps it into the
+ * middle; the reader, when the middle is newer than what it has, swaps its
+ * front one out for it. Neither touches the other's T, and the middle's
+ * index travels in one int along with a bit saying it hasn't been read,
+ * so a swap is a single atomic exchange. A T the reader never got to is
+ * simply overwritten.
+ */
+template <class T>
+class TripleBuffer {
+  public:
+    TripleBuffer() : back(0), middle(1), front(2) {}
+
+    /* writer: fill this, then Publish it */
+    T& Back() { return buf[back]; }
+
+    void Publish() {
+        back = Exchange(back | FRESH) & ~FRESH;
+    }
+
+    /* reader: take the latest published T if it's newer than Front() */
+    bool Update() {
+        if (!(__sync_fetch_and_or(&middle, 0) & FRESH))
+            return false;
+        front = Exchange(front) & ~FRESH;
+        return true;
+    }
+
+    const T& Front() { return buf[front]; }
+
+  private:
+    enum { FRESH = 4 };
+
+    T buf[3];
+    int back, middle, front;
+
+    int Exchange(int value) {
+        int old;
+        do {
+            old = middle;
+        } while (__sync_val_compare_and_swap(&middle, old, value) != old);
+        return old;
+    }
+
+    TripleBuffer(const TripleBuffer&);
+    TripleBuffer& operator=(const TripleBuffer&);
+};
+
+#endif /* _TRIPLEBUFFER_H_ */
@@ -0,0 +1,173 @@
+#include "VertexHierarchy.h"
+#include "Object.h"
+
+#include <map>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+/* vertices a split and its fins touch */
+static void
+touched(VertexSplit *vs, vector<Vertex*> &verts) {
+    if (vs == NULL)
+        return;
+    verts.push_back(vs->target);
+    verts.push_back(vs->newpoint);
+    if (vs->vA) verts.push_back(vs->vA);
+    if (vs->vB) verts.push_back(vs->vB);
+    touched(vs->degenA, verts);
+    touched(vs->degenB, verts);
+}
+
+/* where v was just after the collapse being looked at */
+static vec3
+positionAt(map<Vertex*,vec3> &at, Vertex *v) {
+    map<Vertex*,vec3>::iterator it = at.find(v);
+    return (it != at.end()) ? it->second : v->dstval;
+}
+
+/* step back over a collapse, fins first since they came after it */
+static void
+moveBack(VertexSplit *vs, map<Vertex*,vec3> &at) {
+    if (vs == NULL)
+        return;
+    moveBack(vs->degenB, at);
+    moveBack(vs->degenA, at);
+    at[vs->target] = vs->target_loc;
+}
+
+static void
+link(vector<int> &list, int i) {
+    if (find(list.begin(), list.end(), i) == list.end())
+        list.push_back(i);
+}
+
+VertexHierarchy::VertexHierarchy(Object *o) : o(o), ncollapsed(0) {
+    /* take over the collapses already made, then finish the job */
+    o->DropRedo();
+    vector<VertexSplit*> splits(o->vsplits);
+    o->vsplits.clear();
+    while (VertexSplit *vs = o->CollapseNext())
+        splits.push_back(vs);
+
+    nodes.resize(splits.size());
+    ncollapsed = nodes.size();
+
+    /* how far each collapse moved things, and what it reached, measured
+     * where the vertices were at the time: walk back from the fully
+     * collapsed mesh, undoing each collapse's move as it's passed */
+    map<Vertex*,vec3> at;
+    for (int i = nodes.size() - 1; i >= 0; i--) {
+        Node &n = nodes[i];
+        VertexSplit *vs = splits[i];
+        n.vs = vs;
+        n.split = false;
+
+        n.center = vs->collapse_loc;
+        n.error = std::max(length(vs->target_loc - n.center),
+                           length(positionAt(at, vs->newpoint) - n.center));
+        n.radius = n.error;
+
+        vector<Vertex*> verts;
+        touched(vs, verts);
+        foreach(Vertex *v, verts)
+            n.radius = std::max(n.radius, length(positionAt(at, v) - n.center));
+        moveBack(vs, at);
+    }
+
+    map<Vertex*,int> last; // latest node to touch each vertex
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        Node &n = nodes[i];
+        vector<Vertex*> verts;
+        touched(n.vs, verts);
+        foreach(Vertex *v, verts) {
+            map<Vertex*,int>::iterator it = last.find(v);
+            if (it != last.end() && it->second != (int) i) {
+                link(n.before, it->second);
+                link(nodes[it->second].after, i);
+            }
+            last[v] = i;
+        }
+
+        /* cover everything this depends on */
+        foreach(int j, n.before) {
+            n.error = std::max(n.error, nodes[j].error);
+            n.radius = std::max(n.radius, length(n.center - nodes[j].center) + nodes[j].radius);
+        }
+    }
+}
+
+/* Leaves the Object fully refined. */
+VertexHierarchy::~VertexHierarchy() {
+    for (int i = nodes.size() - 1; i >= 0; i--) {
+        if (!nodes[i].split)
+            nodes[i].vs->Apply(o);
+        o->FreeSplit(nodes[i].vs);
+    }
+}
+
+bool
+VertexHierarchy::CanSplit(int i) {
+    foreach(int j, nodes[i].after)
+        if (!nodes[j].split)
+            return false;
+    return true;
+}
+
+bool
+VertexHierarchy::CanCollapse(int i) {
+    foreach(int j, nodes[i].before)
+        if (nodes[j].split)
+            return false;
+    return true;
+}
+
+void
+VertexHierarchy::Adapt(const mat4 &modelview, float fovy, float aspect,
+        int height, float tolerance) {
+    const float znear = 0.01f;
+    float ty = tan(fovy * M_PI / 360.0),
+          tx = ty * aspect,
+          sy = sqrt(1 + ty*ty),
+          sx = sqrt(1 + tx*tx),
+          pixels = height / (2.0f * ty); // per unit length at unit distance
+
+    /* a node wants splitting if its sphere is in the view frustum and its
+     * error covers too many pixels at the sphere's nearest point */
+    vector<bool> want(nodes.size());
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        Node &n = nodes[i];
+        vec4 c = modelview * vec4(n.center.x, n.center.y, n.center.z, 1.0f);
+        float depth = -c.z;
+
+        if (depth + n.radius < znear ||
+                fabs(c.x) > depth * tx + n.radius * sx ||
+                fabs(c.y) > depth * ty + n.radius * sy) {
+            want[i] = false;
+            continue;
+        }
+
+        float d = std::max(length(vec3(c.x, c.y, c.z)) - n.radius, znear);
+        want[i] = n.error * pixels / d > tolerance;
+    }
+
+    /* the error and sphere grow along dependencies, so a node that wants
+     * splitting only depends on nodes that do too; CanSplit and
+     * CanCollapse just guard against rounding */
+    for (int i = nodes.size() - 1; i >= 0; i--) {
+        if (!nodes[i].split && want[i] && CanSplit(i)) {
+            nodes[i].vs->Apply(o);
+            nodes[i].split = true;
+            ncollapsed--;
+        }
+    }
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        if (nodes[i].split && !want[i] && CanCollapse(i)) {
+            nodes[i].vs->Redo(o);
+            nodes[i].split = false;
+            ncollapsed++;
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef _VERTEXHIERARCHY_H_
+#define _VERTEXHIERARCHY_H_
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+class Object;
+class VertexSplit;
+
+/*
+ * View-dependent refinement over a progressive mesh.
+ *
+ * Building one collapses the Object as far as it will go and keeps every
+ * collapse, in order, as a node. A node depends on the last earlier node
+ * that touched any of its vertices: it can only be collapsed while those
+ * are collapsed, and they can only be split once it is. Anything that
+ * respects that leaves every split's neighbourhood the way Apply and Redo
+ * expect, so nodes can be split and collapsed in any legal order instead
+ * of as a stack.
+ *
+ * Each node gets a bounding sphere and an error that are grown to cover
+ * the nodes it depends on, which makes "needs splitting" monotone along
+ * dependencies: Adapt can refine by splitting from the coarsest node
+ * down and coarsen by collapsing from the finest node up.
+ */
+class VertexHierarchy {
+  public:
+    VertexHierarchy(Object *o);
+    ~VertexHierarchy();
+
+    /* Split nodes whose error projects to more than tolerance pixels
+     * under this camera and collapse the rest. fovy is in degrees. */
+    void Adapt(const glm::mat4 &modelview, float fovy, float aspect,
+            int height, float tolerance);
+
+    int size() { return nodes.size(); }
+    int collapsed() { return ncollapsed; }
+
+  private:
+    struct Node {
+        VertexSplit *vs;
+        glm::vec3 center;
+        float radius;
+        float error;
+        bool split;
+        std::vector<int> before; // must be collapsed for this to collapse
+        std::vector<int> after;  // must be split for this to split
+    };
+
+    Object *o;
+    std::vector<Node> nodes;
+    int ncollapsed;
+
+    bool CanSplit(int i);
+    bool CanCollapse(int i);
+
+    VertexHierarchy(const VertexHierarchy&);
+    VertexHierarchy& operator=(const VertexHierarchy&);
+};
+
+#endif /* _VERTEXHIERARCHY_H_ */
@@ -0,0 +1,129 @@
+#include "Weld.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+/* a vertex and the grid cell it falls in, sorted by cell */
+struct Cell {
+    long long x, y, z;
+    int v;
+
+    bool operator<(const Cell &o) const {
+        if (x != o.x) return x < o.x;
+        if (y != o.y) return y < o.y;
+        if (z != o.z) return z < o.z;
+        return v < o.v;
+    }
+    bool SameCell(const Cell &o) const {
+        return x == o.x && y == o.y && z == o.z;
+    }
+};
+
+int
+WeldVertices(vector<vec3> &verts, float tolerance, vector<int> &remap) {
+    int n = verts.size();
+    remap.resize(n);
+    if (n == 0)
+        return 0;
+
+    /* cells as wide as the tolerance, so matches are in the 27 around */
+    vec3 lo = verts[0], hi = verts[0];
+    for (int i = 1; i < n; i++) {
+        lo = glm::min(lo, verts[i]);
+        hi = glm::max(hi, verts[i]);
+    }
+    double extent = std::max(hi.x - lo.x, std::max(hi.y - lo.y, hi.z - lo.z));
+    double size = (tolerance > 0.0f) ? tolerance : (extent > 0.0) ? 1e-6 * extent : 1.0;
+    double tol2 = (tolerance > 0.0f) ? (double) tolerance * tolerance : 0.0;
+
+    vector<Cell> cells(n);
+    #pragma omp parallel for
+    for (int i = 0; i < n; i++) {
+        Cell &c = cells[i];
+        c.x = (long long) floor((verts[i].x - lo.x) / size);
+        c.y = (long long) floor((verts[i].y - lo.y) / size);
+        c.z = (long long) floor((verts[i].z - lo.z) / size);
+        c.v = i;
+    }
+    sort(cells.begin(), cells.end());
+
+    /* each vertex's lowest-numbered neighbour within tolerance, itself if none */
+    vector<int> lowest(n);
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (int i = 0; i < n; i++) {
+        const Cell &c = cells[i];
+        vec3 p = verts[c.v];
+        int best = c.v;
+        for (int dx = -1; dx <= 1; dx++)
+        for (int dy = -1; dy <= 1; dy++)
+        for (int dz = -1; dz <= 1; dz++) {
+            Cell key = { c.x + dx, c.y + dy, c.z + dz, -1 };
+            vector<Cell>::iterator it = lower_bound(cells.begin(), cells.end(), key);
+            for (; it != cells.end() && it->SameCell(key) && it->v < best; it++) {
+                vec3 q = verts[it->v];
+                double ex = p.x - q.x, ey = p.y - q.y, ez = p.z - q.z;
+                if (ex*ex + ey*ey + ez*ez <= tol2)
+                    best = it->v;
+            }
+        }
+        lowest[c.v] = best;
+    }
+
+    /* links only point back, so one pass in order follows every chain */
+    int nkept = 0;
+    for (int i = 0; i < n; i++) {
+        if (lowest[i] == i) {
+            remap[i] = nkept;
+            verts[nkept++] = verts[i];
+        } else {
+            remap[i] = remap[lowest[i]];
+        }
+    }
+    verts.resize(nkept);
+    return n - nkept;
+}
+
+int
+RemapTris(vector<int> &tris, vector<int> &remap) {
+    int nfaces = tris.size() / 3, nkept = 0;
+    for (int i = 0; i < nfaces; i++) {
+        int a = remap[tris[3*i]], b = remap[tris[3*i+1]], c = remap[tris[3*i+2]];
+        if (a == b || b == c || c == a)
+            continue;
+        tris[3*nkept] = a;
+        tris[3*nkept+1] = b;
+        tris[3*nkept+2] = c;
+        nkept++;
+    }
+    tris.resize(3 * nkept);
+    return nfaces - nkept;
+}
+
+int
+CompactVerts(vector<vec3> &verts, vector<int> &tris) {
+    vector<int> used(verts.size(), 0);
+    for (unsigned int i = 0; i < tris.size(); i++)
+        used[tris[i]] = 1;
+    int ndropped = DropUnused(verts, used);
+    if (ndropped > 0)
+        RemapTris(tris, used);
+    return ndropped;
+}
+
+int
+DropUnused(vector<vec3> &verts, vector<int> &used) {
+    int n = verts.size(), nkept = 0;
+    for (int i = 0; i < n; i++) {
+        if (used[i]) {
+            used[i] = nkept;
+            verts[nkept++] = verts[i];
+        } else {
+            used[i] = -1;
+        }
+    }
+    verts.resize(nkept);
+    return n - nkept;
+}
@@ -0,0 +1,36 @@
+#ifndef _WELD_H_
+#define _WELD_H_
+
+#include <vector>
+
+#include "core.h"
+
+/*
+ * Load-time vertex welding. Exporters often write a vertex once per UV
+ * seam or material that meets it; the copies split the surface into
+ * pieces joined only by boundary edges, which can't be collapsed across.
+ *
+ * WeldVertices merges every vertex within tolerance of another (0 for
+ * exact duplicates) into the lowest-numbered one it's chained to, keeps
+ * one of each in verts, and gives in remap where each old vertex went.
+ * Neighbours are found through a grid of tolerance-sized cells, one
+ * vertex per thread when built with OpenMP. Returns how many vertices
+ * were merged away.
+ *
+ * RemapTris renumbers the corners of an indexed triangle list by remap
+ * and drops faces that welding left with two corners the same. Returns
+ * how many faces were dropped.
+ *
+ * Dropped faces can leave vertices no face uses, which the mesh can't
+ * hold. CompactVerts removes them from verts and renumbers tris to match.
+ * DropUnused does the same given in used a nonzero entry for each vertex
+ * some face uses, for triangles that aren't all in memory; it leaves in
+ * used where each vertex went, -1 if removed, to RemapTris by. Both
+ * return how many vertices were removed.
+ */
+int WeldVertices(std::vector<glm::vec3> &verts, float tolerance, std::vector<int> &remap);
+int RemapTris(std::vector<int> &tris, std::vector<int> &remap);
+int CompactVerts(std::vector<glm::vec3> &verts, std::vector<int> &tris);
+int DropUnused(std::vector<glm::vec3> &verts, std::vector<int> &used);
+
+#endif /* _WELD_H_ */
@@ -0,0 +1,326 @@
+/**
+ * Parallel batch simplification.
+ *
+ *   batch [-j threads] [-m megabytes] [-r ratio | -f faces] [-w tolerance]
+ *         [-z] [-o outdir] [-t report.tsv] models/ | manifest.txt
+ *
+ * Simplifies every OFF mesh in a directory, or every path listed one per
+ * line in a manifest, to `ratio` of its faces (0.1 by default) or to
+ * `faces` faces, and writes each to outdir ("simplified" by default)
+ * under its own name. With -w, vertices within tolerance of each other
+ * are welded as each mesh is read; with -z, each is laid out in memory
+ * along a Morton curve before simplifying.
+ *
+ * Meshes go to `threads` workers (one per core by default) largest first,
+ * so the long ones aren't left for the end. The cores are split between
+ * the workers: each runs the core's OpenMP loops on cores / threads
+ * threads (at least one), so fewer workers still use every core and the
+ * default never runs more threads than cores. A worker only starts a mesh
+ * if its estimated half-edge structure fits in what's left of the -m
+ * budget (1024 MB by default), passing over larger meshes for one that
+ * does; a mesh too big for the budget on its own runs once nothing else
+ * is. Each worker reads every mesh into the same Object, so its pools'
+ * slabs are reused from one mesh to the next.
+ *
+ * Timings for every mesh are written to report.tsv (outdir/report.tsv by
+ * default): faces in and out, seconds to read, to build the quadrics and
+ * queue, to collapse and to write, and which worker ran it.
+ */
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "Object.h"
+#include "timer.h"
+#include "files.h"
+
+using namespace std;
+
+struct Job {
+    string path, name;
+    int faces;   // from the header, for ordering and admission
+    long bytes;  // estimated in-core size
+    bool ok;
+    int faces_out, worker;
+    double load_s, queue_s, simplify_s, write_s;
+};
+
+static bool
+largerFirst(const Job *a, const Job *b) {
+    return a->faces > b->faces;
+}
+
+/* Work left to hand out, and the memory taken by what's running. */
+struct Batch {
+    pthread_mutex_t lock;
+    pthread_cond_t freed;
+    vector<Job*> pending; // largest first
+    long budget, inflight;
+    int running;
+    int ompthreads; // for each worker's OpenMP loops
+
+    double ratio;
+    int faces;
+    float weld;
+    bool reorder;
+    string outdir;
+};
+
+struct Worker {
+    pthread_t thread;
+    Batch *batch;
+    int id;
+};
+
+/* Next mesh that fits, waiting for memory if none does; NULL when done. */
+static Job*
+admit(Batch *b) {
+    pthread_mutex_lock(&b->lock);
+    Job *job = NULL;
+    while (!b->pending.empty()) {
+        unsigned int i = 0;
+        while (i < b->pending.size() && b->inflight + b->pending[i]->bytes > b->budget)
+            i++;
+        if (i == b->pending.size() && b->running == 0)
+            i = 0; // too big to share the budget; run it alone
+        if (i < b->pending.size()) {
+            job = b->pending[i];
+            b->pending.erase(b->pending.begin() + i);
+            b->inflight += job->bytes;
+            b->running++;
+            break;
+        }
+        pthread_cond_wait(&b->freed, &b->lock);
+    }
+    pthread_mutex_unlock(&b->lock);
+    return job;
+}
+
+static void
+release(Batch *b, Job *job) {
+    pthread_mutex_lock(&b->lock);
+    b->inflight -= job->bytes;
+    b->running--;
+    pthread_cond_broadcast(&b->freed);
+    pthread_mutex_unlock(&b->lock);
+}
+
+static void
+simplifyMesh(Batch *b, Object *o, Job *job) {
+    FILE *in = fopen(job->path.c_str(), "r");
+    if (in == NULL) {
+        fprintf(stderr, "Unable to open model: %s\n", job->path.c_str());
+        return;
+    }
+    bool read = o->Read(in, b->weld, b->reorder);
+    fclose(in);
+    if (!read) {
+        fprintf(stderr, "Unable to read model: %s\n", job->path.c_str());
+        return;
+    }
+    job->load_s = o->loadTime;
+    job->queue_s = o->queueTime;
+
+    int target = (b->faces >= 0) ? b->faces : (int) (b->ratio * o->faces.size());
+    double start = Now();
+    while ((int) o->faces.size() > target) {
+        int before = o->vsplits.size();
+        o->Pop();
+        if ((int) o->vsplits.size() == before)
+            break; // nothing left that can collapse
+    }
+    job->simplify_s = Now() - start;
+    job->faces_out = o->faces.size();
+
+    start = Now();
+    string outpath = b->outdir + "/" + job->name;
+    FILE *out = fopen(outpath.c_str(), "w");
+    if (out == NULL) {
+        fprintf(stderr, "Unable to open output file: %s\n", outpath.c_str());
+        return;
+    }
+    o->Write(out);
+    fclose(out);
+    job->write_s = Now() - start;
+    job->ok = true;
+}
+
+static void*
+work(void *arg) {
+    Worker *w = (Worker*) arg;
+#ifdef _OPENMP
+    omp_set_num_threads(w->batch->ompthreads);
+#endif
+    Object *o = new Object();
+    while (Job *job = admit(w->batch)) {
+        job->worker = w->id;
+        simplifyMesh(w->batch, o, job);
+        o->Clear();
+        release(w->batch, job);
+    }
+    delete o;
+    return NULL;
+}
+
+/* Paths listed one per line; blank lines and #comments are skipped. */
+static vector<string>
+readManifest(const char *path) {
+    vector<string> paths;
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        fprintf(stderr, "Unable to open manifest: %s\n", path);
+        exit(2);
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), in) != NULL) {
+        char *start = line + strspn(line, " \t");
+        char *end = start + strlen(start);
+        while (end > start && strchr(" \t\r\n", end[-1]))
+            *--end = '\0';
+        if (*start != '\0' && *start != '#')
+            paths.push_back(start);
+    }
+    fclose(in);
+    return paths;
+}
+
+static void
+writeReport(FILE *out, vector<Job> &jobs) {
+    fprintf(out, "mesh\tfaces_in\tfaces_out\tload_s\tqueue_s\tsimplify_s\twrite_s\tworker\n");
+    for (unsigned int i = 0; i < jobs.size(); i++) {
+        Job &j = jobs[i];
+        if (!j.ok) {
+            fprintf(out, "%s\t%d\tfailed\n", j.path.c_str(), j.faces);
+            continue;
+        }
+        fprintf(out, "%s\t%d\t%d\t%.6f\t%.6f\t%.6f\t%.6f\t%d\n", j.path.c_str(), j.faces,
+                j.faces_out, j.load_s, j.queue_s, j.simplify_s, j.write_s, j.worker);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int ncores = std::max(1, (int) sysconf(_SC_NPROCESSORS_ONLN));
+    int nthreads = ncores;
+    long budget = 1024;
+    double ratio = 0.1;
+    int faces = -1;
+    float weld = -1.0f;
+    bool reorder = false;
+    string outdir = "simplified";
+    const char *reportname = NULL;
+
+    int a = 1;
+    for (; a < argc - 1; a++) {
+        if (!strcmp(argv[a], "-j"))
+            nthreads = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "-m"))
+            budget = atol(argv[++a]);
+        else if (!strcmp(argv[a], "-r"))
+            ratio = atof(argv[++a]);
+        else if (!strcmp(argv[a], "-f"))
+            faces = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "-w"))
+            weld = atof(argv[++a]);
+        else if (!strcmp(argv[a], "-z"))
+            reorder = true;
+        else if (!strcmp(argv[a], "-o"))
+            outdir = argv[++a];
+        else if (!strcmp(argv[a], "-t"))
+            reportname = argv[++a];
+        else
+            break;
+    }
+    if (a != argc - 1 || nthreads <= 0 || budget <= 0 || ratio <= 0.0) {
+        fprintf(stderr, "Usage: %s [-j threads] [-m megabytes] [-r ratio | -f faces] "
+                "[-w tolerance] [-z] [-o outdir] [-t report.tsv] models/ | manifest.txt\n", argv[0]);
+        exit(1);
+    }
+    budget <<= 20;
+
+    struct stat st;
+    if (stat(argv[a], &st) != 0) {
+        fprintf(stderr, "Unable to find input: %s\n", argv[a]);
+        exit(2);
+    }
+    vector<string> paths = S_ISDIR(st.st_mode) ? listDir(argv[a], ".off") : readManifest(argv[a]);
+
+    if (mkdir(outdir.c_str(), 0777) != 0 && (stat(outdir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))) {
+        fprintf(stderr, "Unable to create output directory: %s\n", outdir.c_str());
+        exit(2);
+    }
+
+    vector<Job> jobs(paths.size());
+    Batch b;
+    for (unsigned int i = 0; i < paths.size(); i++) {
+        Job &j = jobs[i];
+        j.path = paths[i];
+        j.name = paths[i].substr(paths[i].rfind('/') + 1);
+        j.faces = countFaces(paths[i]);
+        j.bytes = (long) std::max(j.faces, 0) * BYTES_PER_FACE;
+        j.ok = false;
+        j.faces_out = j.worker = -1;
+        j.load_s = j.queue_s = j.simplify_s = j.write_s = 0.0;
+        if (j.faces < 0)
+            fprintf(stderr, "Not an OFF file: %s\n", paths[i].c_str());
+        else
+            b.pending.push_back(&j);
+    }
+    stable_sort(b.pending.begin(), b.pending.end(), largerFirst);
+
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_cond_init(&b.freed, NULL);
+    b.budget = budget;
+    b.inflight = 0;
+    b.running = 0;
+    b.ompthreads = std::max(1, ncores / nthreads);
+    b.ratio = ratio;
+    b.faces = faces;
+    b.weld = weld;
+    b.reorder = reorder;
+    b.outdir = outdir;
+
+    double start = Now();
+    vector<Worker> workers(nthreads);
+    for (int i = 0; i < nthreads; i++) {
+        workers[i].batch = &b;
+        workers[i].id = i;
+        if (pthread_create(&workers[i].thread, NULL, work, &workers[i]) != 0) {
+            fprintf(stderr, "Unable to start worker thread\n");
+            exit(2);
+        }
+    }
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(workers[i].thread, NULL);
+    double elapsed = Now() - start;
+
+    pthread_mutex_destroy(&b.lock);
+    pthread_cond_destroy(&b.freed);
+
+    string reportpath = (reportname) ? string(reportname) : outdir + "/report.tsv";
+    FILE *report = fopen(reportpath.c_str(), "w");
+    if (report == NULL) {
+        fprintf(stderr, "Unable to open report file: %s\n", reportpath.c_str());
+        exit(2);
+    }
+    writeReport(report, jobs);
+    fclose(report);
+
+    int failed = 0;
+    for (unsigned int i = 0; i < jobs.size(); i++)
+        failed += !jobs[i].ok;
+    fprintf(stderr, "batch: %d meshes, %d failed, %.3f s on %d threads\n",
+            (int) jobs.size(), failed, elapsed, nthreads);
+    return (failed > 0) ? 3 : 0;
+}
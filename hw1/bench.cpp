@@ -0,0 +1,327 @@
+/**
+ * Simplification benchmark.
+ *
+ *   bench [-o results.json] [-b baseline.json] [-t percent] [-m path/to/models]
+ *         [-r repeats] [-q]
+ *
+ * Loads every OFF mesh in the models directory and times, best of
+ * `repeats`: reading and linking it, building the initial quadrics and
+ * collapse queue, collapsing down to each of RATIOS of its faces in turn,
+ * and replaying every vertex split back to the full mesh. Each model runs
+ * in a child process so its peak RSS is its own; one that fails is left
+ * out of the results and makes the exit status 1, but the others still
+ * run. Results are written as JSON.
+ *
+ * With -b the results are also compared to a baseline written by an
+ * earlier run; anything more than `percent` (10 by default) slower or
+ * bigger is flagged and the exit status is 1. -q skips meshes over 10000
+ * faces.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "Object.h"
+#include "timer.h"
+#include "files.h"
+
+using namespace std;
+
+static const double RATIOS[] = { 0.5, 0.25, 0.1, 0.01 };
+#define NRATIOS (int) (sizeof(RATIOS) / sizeof(RATIOS[0]))
+
+/* Everything measured for one model; sent back from the child as is. */
+struct ModelResult {
+    int vertices, faces;
+    double load_s, queue_s;
+    struct {
+        int faces, collapses;
+        double seconds;
+    } ratio[NRATIOS];
+    int splits;
+    double split_s;
+};
+
+/* One timed pass: load, collapse through every ratio, split back. */
+static void
+measure(string path, ModelResult &r) {
+    FILE *in = fopen(path.c_str(), "r");
+    if (in == NULL) {
+        fprintf(stderr, "Unable to open model: %s\n", path.c_str());
+        exit(2);
+    }
+    Object *o = new Object(in);
+    fclose(in);
+
+    r.vertices = o->vertices.size();
+    r.faces = o->faces.size();
+    r.load_s = o->loadTime;
+    r.queue_s = o->queueTime;
+
+    for (int i = 0; i < NRATIOS; i++) {
+        int target = (int) (RATIOS[i] * r.faces);
+        double start = Now();
+        r.ratio[i].collapses = o->Simplify(target);
+        r.ratio[i].seconds = Now() - start;
+        r.ratio[i].faces = o->faces.size();
+    }
+
+    r.splits = o->vsplits.size();
+    double start = Now();
+    while (!o->vsplits.empty())
+        o->Split(/* many = */ true);
+    r.split_s = Now() - start;
+
+    delete o;
+}
+
+/* Best of repeats for every timing. */
+static void
+runModel(string path, int repeats, ModelResult &best) {
+    for (int rep = 0; rep < repeats; rep++) {
+        ModelResult r;
+        measure(path, r);
+        if (rep == 0) {
+            best = r;
+            continue;
+        }
+        best.load_s = std::min(best.load_s, r.load_s);
+        best.queue_s = std::min(best.queue_s, r.queue_s);
+        for (int i = 0; i < NRATIOS; i++)
+            best.ratio[i].seconds = std::min(best.ratio[i].seconds, r.ratio[i].seconds);
+        best.split_s = std::min(best.split_s, r.split_s);
+    }
+}
+
+/* Run a model in a child process. Returns false if it didn't finish. */
+static bool
+forkModel(string path, int repeats, ModelResult &r, long &peak_rss_kb) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        fprintf(stderr, "Unable to create pipe\n");
+        exit(2);
+    }
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Unable to fork\n");
+        exit(2);
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        freopen("/dev/null", "w", stdout); // DEBUG builds report checks here
+        runModel(path, repeats, r);
+        bool ok = write(fds[1], &r, sizeof(r)) == (ssize_t) sizeof(r);
+        _exit(ok ? 0 : 1);
+    }
+
+    close(fds[1]);
+    bool ok = read(fds[0], &r, sizeof(r)) == (ssize_t) sizeof(r);
+    close(fds[0]);
+
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+#if defined(__APPLE__)
+    peak_rss_kb = usage.ru_maxrss / 1024;
+#else
+    peak_rss_kb = usage.ru_maxrss;
+#endif
+    return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static double
+rate(int count, double seconds) {
+    return (seconds > 0.0) ? count / seconds : 0.0;
+}
+
+static void
+writeModel(FILE *out, string name, ModelResult &r, long peak_rss_kb, bool first) {
+    fprintf(out, "%s    {\n", first ? "" : ",\n");
+    fprintf(out, "      \"name\": \"%s\",\n", name.c_str());
+    fprintf(out, "      \"vertices\": %d,\n", r.vertices);
+    fprintf(out, "      \"faces\": %d,\n", r.faces);
+    fprintf(out, "      \"load_s\": %.6f,\n", r.load_s);
+    fprintf(out, "      \"queue_s\": %.6f,\n", r.queue_s);
+    fprintf(out, "      \"collapses\": [");
+    for (int i = 0; i < NRATIOS; i++)
+        fprintf(out, "%s\n        { \"ratio\": %g, \"faces\": %d, \"collapses\": %d, "
+                "\"seconds\": %.6f, \"collapses_per_s\": %.1f }",
+                i ? "," : "", RATIOS[i], r.ratio[i].faces, r.ratio[i].collapses,
+                r.ratio[i].seconds, rate(r.ratio[i].collapses, r.ratio[i].seconds));
+    fprintf(out, "\n      ],\n");
+    fprintf(out, "      \"splits\": %d,\n", r.splits);
+    fprintf(out, "      \"split_s\": %.6f,\n", r.split_s);
+    fprintf(out, "      \"splits_per_s\": %.1f,\n", rate(r.splits, r.split_s));
+    fprintf(out, "      \"peak_rss_kb\": %ld\n", peak_rss_kb);
+    fprintf(out, "    }");
+}
+
+/*
+ * Pull "key": number pairs out of a results file written by writeModel,
+ * keyed by model name, collapse ratio (if any) and key.
+ */
+static map<string,double>
+readResults(const char *path) {
+    map<string,double> values;
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        fprintf(stderr, "Unable to open baseline: %s\n", path);
+        exit(2);
+    }
+
+    string model, ratio;
+    char line[1024];
+    while (fgets(line, sizeof(line), in) != NULL) {
+        char name[256];
+        if (sscanf(line, " \"name\": \"%255[^\"]\"", name) == 1) {
+            model = name;
+            continue;
+        }
+        /* a ratio applies to the rest of its line */
+        ratio = "";
+        char *p = line;
+        while ((p = strchr(p, '"')) != NULL) {
+            char key[64];
+            double value;
+            int used;
+            if (sscanf(p, "\"%63[^\"]\": %lf%n", key, &value, &used) != 2) {
+                p++;
+                continue;
+            }
+            p += used;
+            if (!strcmp(key, "ratio")) {
+                char buf[32];
+                snprintf(buf, sizeof(buf), "%g/", value);
+                ratio = buf;
+            } else {
+                values[model + "/" + ratio + key] = value;
+            }
+        }
+    }
+    fclose(in);
+    return values;
+}
+
+/* Print every shared metric; returns the number of regressions. */
+static int
+compare(map<string,double> &base, map<string,double> &now, double percent) {
+    const char *higherBetter[] = { "collapses_per_s", "splits_per_s" };
+    const char *lowerBetter[] = { "load_s", "queue_s", "peak_rss_kb" };
+
+    int regressions = 0;
+    fprintf(stderr, "%-40s %14s %14s %8s\n", "metric", "baseline", "current", "change");
+    for (map<string,double>::iterator it = now.begin(); it != now.end(); it++) {
+        string key = it->first;
+        string metric = key.substr(key.rfind('/') + 1);
+
+        int sense = 0;
+        for (int i = 0; i < 2; i++)
+            if (metric == higherBetter[i]) sense = 1;
+        for (int i = 0; i < 3; i++)
+            if (metric == lowerBetter[i]) sense = -1;
+        if (sense == 0 || base.count(key) == 0 || base[key] == 0.0)
+            continue;
+
+        double change = 100.0 * (it->second - base[key]) / base[key];
+        bool worse = sense * change < -percent;
+        regressions += worse;
+        fprintf(stderr, "%-40s %14.6g %14.6g %+7.1f%%%s\n", key.c_str(),
+                base[key], it->second, change, worse ? "  <-- worse" : "");
+    }
+    return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *outname = NULL, *basename = NULL;
+    string modeldir = "models";
+    int repeats = 3;
+    double percent = 10.0;
+    bool quick = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            outname = argv[++i];
+        else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+            basename = argv[++i];
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            percent = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+            modeldir = argv[++i];
+        else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+            repeats = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-q"))
+            quick = true;
+        else {
+            fprintf(stderr, "Usage: %s [-o results.json] [-b baseline.json] [-t percent] "
+                    "[-m path/to/models] [-r repeats] [-q]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    if (basename != NULL && outname == NULL) {
+        fprintf(stderr, "Comparing against a baseline needs -o\n");
+        exit(1);
+    }
+
+    /* read it first in case it's also the output */
+    map<string,double> baseline;
+    if (basename != NULL)
+        baseline = readResults(basename);
+
+    FILE *out = stdout;
+    if (outname != NULL && (out = fopen(outname, "w")) == NULL) {
+        fprintf(stderr, "Unable to open output file: %s\n", outname);
+        exit(2);
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"repeats\": %d,\n", repeats);
+    fprintf(out, "  \"models\": [\n");
+
+    vector<string> models = listDir(modeldir, ".off");
+    bool first = true;
+    int failed = 0;
+    for (unsigned int i = 0; i < models.size(); i++) {
+        int nfaces = countFaces(models[i]);
+        if (nfaces < 0 || (quick && nfaces > 10000))
+            continue;
+
+        string name = models[i].substr(models[i].rfind('/') + 1);
+        fprintf(stderr, "bench: %s\n", name.c_str());
+
+        ModelResult r;
+        long peak_rss_kb;
+        if (!forkModel(models[i], repeats, r, peak_rss_kb)) {
+            fprintf(stderr, "bench: %s failed\n", name.c_str());
+            failed++;
+            continue;
+        }
+        writeModel(out, name, r, peak_rss_kb, first);
+        first = false;
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout)
+        fclose(out);
+
+    int regressions = 0;
+    if (basename != NULL) {
+        map<string,double> current = readResults(outname);
+        regressions = compare(baseline, current, percent);
+    }
+
+    return (failed > 0 || regressions > 0) ? 1 : 0;
+}
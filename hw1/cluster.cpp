@@ -0,0 +1,495 @@
+/**
+ * Vertex-clustering decimation for meshes too big for the viewer.
+ *
+ *   cluster [-r resolution] [-e tolerance] input.off output.off
+ *
+ * Lays a grid of `resolution` cells along the longest side of the model's
+ * bounding box (the same box Object::SetCenterSize centers on), merges the
+ * vertices in each cell into the point that minimizes the cell's quadric
+ * error and drops triangles that collapse. Faces are streamed in chunks and
+ * never held in full.
+ *
+ * With -e the grid is an octree instead: resolution is rounded up to a
+ * power of two and sibling cells are merged bottom-up as long as the RMS
+ * quadric error of the merged cell stays under `tolerance` times the size
+ * of the bounding box, and a level's merges are kept only if some triangle
+ * survives them, so a flat model doesn't vanish into a single cell.
+ */
+
+#include <vector>
+#include <algorithm>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <cctype>
+
+#include <stdint.h>
+
+using namespace std;
+
+#define FACE_CHUNK (1 << 20)
+
+/* whitespace-separated tokens off a FILE*, much faster than fscanf */
+class Reader {
+  public:
+    Reader(FILE *f) : f(f), pos(0), len(0) {}
+
+    bool Token(char *tok, int max) {
+        int c;
+        while ((c = Get()) != EOF && isspace(c))
+            ;
+        int n = 0;
+        while (c != EOF && !isspace(c) && n < max - 1) {
+            tok[n++] = c;
+            c = Get();
+        }
+        tok[n] = '\0';
+        return n > 0;
+    }
+
+    bool Int(int &i) {
+        char tok[64];
+        if (!Token(tok, sizeof(tok)))
+            return false;
+        i = atoi(tok);
+        return true;
+    }
+
+    bool Float(float &x) {
+        char tok[64];
+        if (!Token(tok, sizeof(tok)))
+            return false;
+        x = strtof(tok, NULL);
+        return true;
+    }
+
+  private:
+    int Get() {
+        if (pos == len) {
+            len = fread(buf, 1, sizeof(buf), f);
+            pos = 0;
+            if (len <= 0)
+                return EOF;
+        }
+        return buf[pos++];
+    }
+
+    FILE *f;
+    char buf[1 << 16];
+    int pos, len;
+};
+
+/* Symmetric 4x4 quadric, upper triangle row by row:
+ * a00 a01 a02 a03 a11 a12 a13 a22 a23 a33 */
+struct Cell {
+    uint64_t key;     // Morton code of the (first) finest cell covered
+    int level;        // octree depth, finest cells are at the deepest level
+    int parent;       // cell this one was merged into, or -1
+    double q[10];
+    double area;      // total weight of the planes in q
+    double sum[3];    // for the mean of the vertices
+    int nverts;
+    float pos[3];
+    int index;        // in the output, or -1 if unused
+};
+
+static uint64_t
+spread(uint64_t x) {
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffULL;
+    x = (x | x << 16) & 0x1f0000ff0000ffULL;
+    x = (x | x << 8)  & 0x100f00f00f00f00fULL;
+    x = (x | x << 4)  & 0x10c30c30c30c30c3ULL;
+    x = (x | x << 2)  & 0x1249249249249249ULL;
+    return x;
+}
+
+static double
+evalQ(const double *q, double x, double y, double z) {
+    return q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x
+         + q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y
+         + q[7]*z*z + 2*q[8]*z
+         + q[9];
+}
+
+/* Quadric-optimal point of a cell. Falls back to the mean of its vertices
+ * when the system is ill-conditioned or the optimum lands farther than
+ * `radius` away from it. */
+static void
+placeCell(Cell &c, double radius) {
+    double mean[3] = { c.sum[0] / c.nverts, c.sum[1] / c.nverts, c.sum[2] / c.nverts };
+    const double *q = c.q;
+    double a = q[0], b = q[1], d = q[2], e = q[4], f = q[5], g = q[7];
+    double c0 = e*g - f*f,
+           c1 = d*f - b*g,
+           c2 = b*f - d*e;
+    double det = a*c0 + b*c1 + d*c2;
+    double scale = a + e + g;
+
+    double p[3] = { mean[0], mean[1], mean[2] };
+    if (scale > 0.0 && fabs(det) > 1e-9 * scale*scale*scale) {
+        double r0 = -q[3], r1 = -q[6], r2 = -q[8];
+        double x = (c0*r0 + c1*r1 + c2*r2) / det,
+               y = (c1*r0 + (a*g - d*d)*r1 + (b*d - a*f)*r2) / det,
+               z = (c2*r0 + (b*d - a*f)*r1 + (a*e - b*b)*r2) / det;
+        double dx = x - mean[0], dy = y - mean[1], dz = z - mean[2];
+        if (dx*dx + dy*dy + dz*dz <= radius*radius) {
+            p[0] = x;
+            p[1] = y;
+            p[2] = z;
+        }
+    }
+
+    c.pos[0] = p[0];
+    c.pos[1] = p[1];
+    c.pos[2] = p[2];
+}
+
+static int
+root(vector<Cell> &cells, int c) {
+    while (cells[c].parent >= 0)
+        c = cells[c].parent;
+    return c;
+}
+
+struct Tri {
+    int v[3];
+    bool operator< (const Tri &o) const {
+        return memcmp(v, o.v, sizeof(v)) < 0;
+    }
+    bool operator== (const Tri &o) const {
+        return memcmp(v, o.v, sizeof(v)) == 0;
+    }
+};
+
+/* rotate so the smallest index leads; keeps the winding */
+static Tri
+canonical(int a, int b, int c) {
+    Tri t;
+    if (a < b && a < c)      { t.v[0] = a; t.v[1] = b; t.v[2] = c; }
+    else if (b < c)          { t.v[0] = b; t.v[1] = c; t.v[2] = a; }
+    else                     { t.v[0] = c; t.v[1] = a; t.v[2] = b; }
+    return t;
+}
+
+static void
+dedupe(vector<Tri> &tris) {
+    sort(tris.begin(), tris.end());
+    tris.erase(unique(tris.begin(), tris.end()), tris.end());
+}
+
+int main(int argc, char *argv[])
+{
+    int resolution = 64;
+    double tolerance = -1.0;
+    int a = 1;
+    for (; a < argc - 2; a++) {
+        if (!strcmp(argv[a], "-r") && a + 1 < argc - 2)
+            resolution = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "-e") && a + 1 < argc - 2)
+            tolerance = atof(argv[++a]);
+        else
+            break;
+    }
+    if (a != argc - 2 || resolution < 1 || resolution > (1 << 21)) {
+        fprintf(stderr, "Usage: %s [-r resolution] [-e tolerance] input.off output.off\n", argv[0]);
+        exit(1);
+    }
+
+    int depth = 0;
+    if (tolerance >= 0.0) {
+        while ((1 << depth) < resolution)
+            depth++;
+        resolution = 1 << depth;
+    }
+
+    FILE *input = fopen(argv[a], "r");
+    if (input == NULL) {
+        fprintf(stderr, "Unable to open input file: %s\n", argv[a]);
+        exit(2);
+    }
+    Reader in(input);
+
+    char header[8];
+    int nverts, nfaces, nedges;
+    if (!in.Token(header, sizeof(header)) || strcmp(header, "OFF") ||
+            !in.Int(nverts) || !in.Int(nfaces) || !in.Int(nedges)) {
+        fprintf(stderr, "Not an OFF file: %s\n", argv[a]);
+        exit(3);
+    }
+
+    // -------------------------------------------------------
+    // vertices: bounds, then a cell for each
+
+    vector<float> verts(3 * (size_t) nverts);
+    float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX },
+          hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (int i = 0; i < nverts; i++) {
+        float *v = &verts[3 * (size_t) i];
+        if (!in.Float(v[0]) || !in.Float(v[1]) || !in.Float(v[2])) {
+            fprintf(stderr, "Truncated vertex list in mesh file: %s\n", argv[a]);
+            exit(3);
+        }
+        for (int k = 0; k < 3; k++) {
+            lo[k] = std::min(lo[k], v[k]);
+            hi[k] = std::max(hi[k], v[k]);
+        }
+    }
+
+    double extent = 0.0;
+    for (int k = 0; k < 3; k++)
+        extent = std::max(extent, (double) hi[k] - lo[k]);
+    double cellsize = (extent > 0.0) ? extent / resolution : 1.0;
+
+    vector<uint64_t> keys(nverts);
+    #pragma omp parallel for
+    for (int i = 0; i < nverts; i++) {
+        uint64_t key = 0;
+        for (int k = 0; k < 3; k++) {
+            int c = (int) ((verts[3 * (size_t) i + k] - lo[k]) / cellsize);
+            c = std::max(0, std::min(resolution - 1, c));
+            key |= spread(c) << k;
+        }
+        keys[i] = key;
+    }
+
+    vector<uint64_t> occupied(keys);
+    sort(occupied.begin(), occupied.end());
+    occupied.erase(unique(occupied.begin(), occupied.end()), occupied.end());
+
+    int ncells = occupied.size();
+    vector<Cell> cells(ncells);
+    for (int c = 0; c < ncells; c++) {
+        memset(&cells[c], 0, sizeof(Cell));
+        cells[c].key = occupied[c];
+        cells[c].level = depth;
+        cells[c].parent = -1;
+        cells[c].index = -1;
+    }
+
+    vector<int> vcell(nverts);
+    #pragma omp parallel for
+    for (int i = 0; i < nverts; i++) {
+        int c = lower_bound(occupied.begin(), occupied.end(), keys[i]) - occupied.begin();
+        vcell[i] = c;
+        for (int k = 0; k < 3; k++) {
+            #pragma omp atomic
+            cells[c].sum[k] += verts[3 * (size_t) i + k];
+        }
+        #pragma omp atomic
+        cells[c].nverts++;
+    }
+    vector<uint64_t>().swap(keys);
+    vector<uint64_t>().swap(occupied);
+
+    // -------------------------------------------------------
+    // faces, a chunk at a time: accumulate quadrics, keep the triangles
+    // that span three cells
+
+    vector<Tri> tris;
+    vector<int> chunk;
+    vector<Tri> spans;
+    size_t lastunique = 0;
+    for (int f = 0; f < nfaces; ) {
+        chunk.clear();
+        for (; f < nfaces && chunk.size() < 3 * FACE_CHUNK; f++) {
+            int valence, i0, i1, i2;
+            if (!in.Int(valence) || !in.Int(i0) || !in.Int(i1)) {
+                fprintf(stderr, "Truncated face list in mesh file: %s\n", argv[a]);
+                exit(3);
+            }
+            for (int k = 2; k < valence; k++) {
+                if (!in.Int(i2)) {
+                    fprintf(stderr, "Truncated face list in mesh file: %s\n", argv[a]);
+                    exit(3);
+                }
+                if (i0 < 0 || i1 < 0 || i2 < 0 || i0 >= nverts || i1 >= nverts || i2 >= nverts) {
+                    fprintf(stderr, "Bad vertex index in mesh file: %s\n", argv[a]);
+                    exit(3);
+                }
+                chunk.push_back(i0);
+                chunk.push_back(i1);
+                chunk.push_back(i2);
+                i1 = i2;
+            }
+        }
+
+        int n = chunk.size() / 3;
+        spans.resize(n);
+        #pragma omp parallel for
+        for (int t = 0; t < n; t++) {
+            const float *p0 = &verts[3 * (size_t) chunk[3*t]],
+                        *p1 = &verts[3 * (size_t) chunk[3*t+1]],
+                        *p2 = &verts[3 * (size_t) chunk[3*t+2]];
+            double e1[3] = { p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2] },
+                   e2[3] = { p2[0]-p0[0], p2[1]-p0[1], p2[2]-p0[2] };
+            double nrm[3] = { e1[1]*e2[2] - e1[2]*e2[1],
+                              e1[2]*e2[0] - e1[0]*e2[2],
+                              e1[0]*e2[1] - e1[1]*e2[0] };
+            double len = sqrt(nrm[0]*nrm[0] + nrm[1]*nrm[1] + nrm[2]*nrm[2]);
+            int c[3] = { vcell[chunk[3*t]], vcell[chunk[3*t+1]], vcell[chunk[3*t+2]] };
+
+            if (len > 0.0) {
+                /* area-weighted plane quadric */
+                double area = 0.5 * len;
+                double pl[4] = { nrm[0]/len, nrm[1]/len, nrm[2]/len, 0.0 };
+                pl[3] = -(pl[0]*p0[0] + pl[1]*p0[1] + pl[2]*p0[2]);
+                double q[10] = { pl[0]*pl[0], pl[0]*pl[1], pl[0]*pl[2], pl[0]*pl[3],
+                                 pl[1]*pl[1], pl[1]*pl[2], pl[1]*pl[3],
+                                 pl[2]*pl[2], pl[2]*pl[3],
+                                 pl[3]*pl[3] };
+                for (int v = 0; v < 3; v++) {
+                    for (int k = 0; k < 10; k++) {
+                        #pragma omp atomic
+                        cells[c[v]].q[k] += area * q[k];
+                    }
+                    #pragma omp atomic
+                    cells[c[v]].area += area;
+                }
+            }
+
+            if (c[0] != c[1] && c[1] != c[2] && c[0] != c[2])
+                spans[t] = canonical(c[0], c[1], c[2]);
+            else
+                spans[t].v[0] = -1;
+        }
+
+        for (int t = 0; t < n; t++)
+            if (spans[t].v[0] >= 0)
+                tris.push_back(spans[t]);
+        if (tris.size() > 2 * lastunique + FACE_CHUNK) {
+            dedupe(tris);
+            lastunique = tris.size();
+        }
+    }
+    fclose(input);
+    vector<float>().swap(verts);
+
+    // -------------------------------------------------------
+    // octree: merge siblings bottom-up while the error stays small
+
+    if (tolerance >= 0.0) {
+        double maxerr = tolerance * extent;
+        maxerr *= maxerr;
+
+        vector<int> active(ncells), next;
+        for (int c = 0; c < ncells; c++)
+            active[c] = c;
+
+        for (int level = depth; level > 0; level--) {
+            int shift = 3 * (depth - level + 1);
+            next.clear();
+            int firstmerged = cells.size();
+            for (unsigned int i = 0; i < active.size(); ) {
+                uint64_t group = cells[active[i]].key >> shift;
+                unsigned int j = i;
+                bool mergeable = true;
+                for (; j < active.size() && cells[active[j]].key >> shift == group; j++)
+                    mergeable &= (cells[active[j]].level == level);
+
+                if (mergeable) {
+                    Cell merged = cells[active[i]];
+                    for (unsigned int k = i + 1; k < j; k++) {
+                        Cell &c = cells[active[k]];
+                        for (int m = 0; m < 10; m++)
+                            merged.q[m] += c.q[m];
+                        for (int m = 0; m < 3; m++)
+                            merged.sum[m] += c.sum[m];
+                        merged.area += c.area;
+                        merged.nverts += c.nverts;
+                    }
+                    merged.level = level - 1;
+
+                    double radius = cellsize * (1 << (depth - level + 1)) * sqrt(3.0);
+                    placeCell(merged, radius);
+                    double err = evalQ(merged.q, merged.pos[0], merged.pos[1], merged.pos[2]);
+                    if (err <= maxerr * merged.area) {
+                        int m = cells.size();
+                        for (unsigned int k = i; k < j; k++)
+                            cells[active[k]].parent = m;
+                        cells.push_back(merged);
+                        next.push_back(m);
+                        i = j;
+                        continue;
+                    }
+                }
+
+                for (; i < j; i++)
+                    next.push_back(active[i]);
+            }
+
+            unsigned int survivors = 0;
+            for (unsigned int t = 0; t < tris.size() && survivors == 0; t++) {
+                int c0 = root(cells, tris[t].v[0]),
+                    c1 = root(cells, tris[t].v[1]),
+                    c2 = root(cells, tris[t].v[2]);
+                survivors += (c0 != c1 && c1 != c2 && c0 != c2);
+            }
+            if (survivors == 0 && !tris.empty()) {
+                for (unsigned int c = 0; c < active.size(); c++)
+                    cells[active[c]].parent = -1;
+                cells.resize(firstmerged);
+                break;
+            }
+            active.swap(next);
+        }
+    }
+
+    // -------------------------------------------------------
+    // place the surviving cells and remap triangles onto them
+
+    int ntotal = cells.size();
+    #pragma omp parallel for
+    for (int c = 0; c < ntotal; c++)
+        if (cells[c].parent < 0)
+            placeCell(cells[c], cellsize * (1 << (depth - cells[c].level)) * sqrt(3.0));
+
+    vector<Tri> out;
+    out.reserve(tris.size());
+    for (unsigned int t = 0; t < tris.size(); t++) {
+        int c0 = root(cells, tris[t].v[0]),
+            c1 = root(cells, tris[t].v[1]),
+            c2 = root(cells, tris[t].v[2]);
+        if (c0 != c1 && c1 != c2 && c0 != c2)
+            out.push_back(canonical(c0, c1, c2));
+    }
+    vector<Tri>().swap(tris);
+    dedupe(out);
+
+    int nout = 0;
+    for (unsigned int t = 0; t < out.size(); t++)
+        for (int k = 0; k < 3; k++)
+            if (cells[out[t].v[k]].index < 0)
+                cells[out[t].v[k]].index = nout++;
+
+    // -------------------------------------------------------
+    // write it out
+
+    FILE *output = fopen(argv[a+1], "w");
+    if (output == NULL) {
+        fprintf(stderr, "Unable to open output file: %s\n", argv[a+1]);
+        exit(2);
+    }
+
+    vector<int> order(nout);
+    for (int c = 0; c < ntotal; c++)
+        if (cells[c].index >= 0)
+            order[cells[c].index] = c;
+
+    fprintf(output, "OFF\n%d %d 0\n", nout, (int) out.size());
+    for (int i = 0; i < nout; i++) {
+        Cell &c = cells[order[i]];
+        fprintf(output, "%f %f %f\n", c.pos[0], c.pos[1], c.pos[2]);
+    }
+    for (unsigned int t = 0; t < out.size(); t++)
+        fprintf(output, "3 %d %d %d\n",
+                cells[out[t].v[0]].index, cells[out[t].v[1]].index, cells[out[t].v[2]].index);
+    fclose(output);
+
+    fprintf(stderr, "%d vertices, %d faces -> %d vertices, %d faces\n",
+            nverts, nfaces, nout, (int) out.size());
+    return 0;
+}
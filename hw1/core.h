@@ -0,0 +1,20 @@
+#ifndef _CORE_H_
+#define _CORE_H_
+
+/*
+ * What the mesh and simplification code needs, and nothing to do with
+ * drawing: Object, EdgeQueue, VertexHierarchy, Simplifier and the headers
+ * they use build without GL and keep no mutable globals, so separate
+ * Objects can be simplified on separate threads.
+ */
+
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_access.hpp"
+
+#include <boost/foreach.hpp>
+#define foreach BOOST_FOREACH
+
+/* how long a geomorph takes, in seconds */
+#define MORPH_SECONDS 1.0
+
+#endif /* _CORE_H_ */
@@ -0,0 +1,45 @@
+#ifndef _FILES_H_
+#define _FILES_H_
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+
+/* Paths of the files in dir ending in suffix, sorted. */
+inline std::vector<std::string>
+listDir(std::string dir, std::string suffix) {
+    std::vector<std::string> files;
+    DIR *d = opendir(dir.c_str());
+    if (d == NULL)
+        return files;
+
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        std::string fname(entry->d_name);
+        if (fname.size() > suffix.size() &&
+                fname.compare(fname.size() - suffix.size(), suffix.size(), suffix) == 0)
+            files.push_back(dir + "/" + fname);
+    }
+    closedir(d);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+/* Face count from an OFF file's header, or -1 if it doesn't have one. */
+inline int
+countFaces(std::string path) {
+    FILE *in = fopen(path.c_str(), "r");
+    if (in == NULL)
+        return -1;
+    char header[4];
+    int nverts, nfaces, nedges;
+    int scanned = fscanf(in, "%3s %d %d %d", header, &nverts, &nfaces, &nedges);
+    fclose(in);
+    return (scanned == 4 && !strcmp(header, "OFF")) ? nfaces : -1;
+}
+
+#endif /* _FILES_H_ */
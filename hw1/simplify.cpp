@@ -0,0 +1,616 @@
+/**
+ * Batch QEM simplification.
+ *
+ *   simplify [-f faces,... | -r ratio,... | -e error,...] [-m megabytes]
+ *            [-w tolerance] input.off output.off
+ *
+ * Collapses edges in QEM order until the mesh is down to `faces` faces (or
+ * `ratio` of the input, 0.1 by default), or until the next collapse would
+ * cost more than `error`. Given several targets it makes one decimation
+ * run and writes a snapshot as each is crossed, to output.0.off,
+ * output.1.off, ... numbered in command-line order. Snapshots are written
+ * by a background thread so collapsing doesn't wait on the disk. With -w,
+ * vertices within tolerance of each other are welded first.
+ *
+ * If the half-edge structure for the whole input wouldn't fit in the -m
+ * budget the mesh is simplified out of core: faces are bucketed into a
+ * grid of chunks that each fit, every chunk is simplified on its own with
+ * the vertices it shares with other chunks locked in place, and the
+ * results are stitched back together on the shared vertices. Rounds
+ * repeat with the grid shifted by half a chunk so the old seams land
+ * inside chunks, until the stitched mesh fits and one last in-core pass
+ * takes it through the targets across all seams. Out-of-core rounds never
+ * go below the largest face-count target still to be written; one they
+ * reach before the mesh fits is written from the stitched mesh, seams and
+ * all, and the rounds go on to the next. They don't look at costs, so
+ * error targets they overshoot are written at the start of the last pass.
+ *
+ * Vertex positions are always kept in memory, along with a few bytes per
+ * vertex of bookkeeping; only faces are spilled to temporary files, one
+ * for the mesh and one holding every chunk's faces back to back.
+ */
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <algorithm>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+
+#include <pthread.h>
+
+#include "Object.h"
+#include "Policy.h"
+#include "Weld.h"
+
+using namespace std;
+using namespace glm;
+
+#define SHARED -2
+#define UNSEEN -1
+
+static FILE*
+spill() {
+    FILE *f = tmpfile();
+    if (f == NULL) {
+        fprintf(stderr, "Unable to create temporary file\n");
+        exit(2);
+    }
+    return f;
+}
+
+static void
+writeTris(FILE *f, vector<int> &tris) {
+    if (!tris.empty())
+        fwrite(&tris[0], sizeof(int), tris.size(), f);
+}
+
+static void
+readTris(FILE *f, vector<int> &tris, int ntris) {
+    tris.resize(3 * ntris);
+    if (ntris > 0 && fread(&tris[0], sizeof(int), tris.size(), f) != tris.size()) {
+        fprintf(stderr, "Short read from temporary file\n");
+        exit(2);
+    }
+}
+
+/* RemapTris, marking in used the vertices the faces kept still use. */
+static void
+remapUsed(vector<int> &tris, vector<int> &remap, vector<int> &used) {
+    RemapTris(tris, remap);
+    for (unsigned int i = 0; i < tris.size(); i++)
+        used[tris[i]] = 1;
+}
+
+/* Renumber the ntris triangles spilled to faces by remap, into a new
+ * spill file that replaces it. */
+static void
+remapSpill(FILE *&faces, long ntris, vector<int> &remap) {
+    FILE *out = spill();
+    rewind(faces);
+    vector<int> tris;
+    for (long done = 0; done < ntris; ) {
+        int n = std::min(ntris - done, (long) 1 << 20);
+        readTris(faces, tris, n);
+        done += n;
+        RemapTris(tris, remap);
+        writeTris(out, tris);
+    }
+    fclose(faces);
+    faces = out;
+}
+
+static long
+inCoreBytes(long nfaces) {
+    return nfaces * BYTES_PER_FACE;
+}
+
+/* One level of detail: taken once the mesh is down to `faces` faces or
+ * the next collapse would cost more than `error`. */
+struct Lod {
+    double ratio;  // of the input face count, until it's known
+    int faces;
+    double error;
+    string path;
+    bool done;
+};
+
+struct Snapshot {
+    string path;
+    vector<vec3> verts;
+    vector<int> tris;
+};
+
+/* Writes snapshots handed to it on its own thread, in order. */
+struct SnapshotWriter {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    deque<Snapshot*> pending;
+    bool finished;
+};
+
+static void*
+writeSnapshots(void *arg) {
+    SnapshotWriter *w = (SnapshotWriter*) arg;
+    while (true) {
+        pthread_mutex_lock(&w->lock);
+        while (w->pending.empty() && !w->finished)
+            pthread_cond_wait(&w->ready, &w->lock);
+        if (w->pending.empty()) {
+            pthread_mutex_unlock(&w->lock);
+            return NULL;
+        }
+        Snapshot *s = w->pending.front();
+        w->pending.pop_front();
+        pthread_mutex_unlock(&w->lock);
+
+        FILE *output = fopen(s->path.c_str(), "w");
+        if (output == NULL) {
+            fprintf(stderr, "Unable to open output file: %s\n", s->path.c_str());
+            exit(2);
+        }
+        Object::Write(output, s->verts, s->tris);
+        fclose(output);
+        delete s;
+    }
+}
+
+static void
+startWriter(SnapshotWriter &w) {
+    w.finished = false;
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.ready, NULL);
+    if (pthread_create(&w.thread, NULL, writeSnapshots, &w) != 0) {
+        fprintf(stderr, "Unable to start writer thread\n");
+        exit(2);
+    }
+}
+
+static void
+queueSnapshot(SnapshotWriter &w, Snapshot *s) {
+    pthread_mutex_lock(&w.lock);
+    w.pending.push_back(s);
+    pthread_cond_signal(&w.ready);
+    pthread_mutex_unlock(&w.lock);
+}
+
+/* Wait for everything queued to hit the disk. */
+static void
+finishWriter(SnapshotWriter &w) {
+    pthread_mutex_lock(&w.lock);
+    w.finished = true;
+    pthread_cond_signal(&w.ready);
+    pthread_mutex_unlock(&w.lock);
+    pthread_join(w.thread, NULL);
+    pthread_mutex_destroy(&w.lock);
+    pthread_cond_destroy(&w.ready);
+}
+
+/*
+ * Simplify a mesh that fits in memory through every level of detail in
+ * one run, handing each to the writer as it's crossed.
+ */
+static void
+simplifyInCore(vector<vec3> &verts, vector<int> &tris, vector<Lod> &lods,
+        SnapshotWriter &writer) {
+    Object *o = new Object(verts, tris);
+    int left = 0;
+    for (unsigned int i = 0; i < lods.size(); i++)
+        left += !lods[i].done;
+
+    while (left > 0) {
+        Hedge *next = o->PeekNext();
+        double cost = (next) ? o->queue.TopCost() : DBL_MAX;
+
+        for (unsigned int i = 0; i < lods.size(); i++) {
+            Lod &lod = lods[i];
+            if (lod.done)
+                continue;
+            if (next != NULL && (int) o->faces.size() > lod.faces && cost <= lod.error)
+                continue;
+
+            Snapshot *s = new Snapshot;
+            s->path = lod.path;
+            o->Export(s->verts, s->tris);
+            fprintf(stderr, "%s: %d faces, next collapse costs %g\n",
+                    lod.path.c_str(), (int) o->faces.size(), cost);
+            queueSnapshot(writer, s);
+            lod.done = true;
+            left--;
+        }
+
+        if (next == NULL || left == 0)
+            break;
+        o->vsplits.push_back(o->Collapse(next, o->engine->Place(next)));
+    }
+
+    delete o;
+}
+
+/* Hand the stitched mesh from an out-of-core round to the writer for each
+ * level not yet written with at least `reached` faces. Returns how many
+ * levels are left. */
+static int
+writeStitched(vector<vec3> &verts, FILE *faces, long ntris, long reached,
+        vector<Lod> &lods, SnapshotWriter &writer) {
+    vector<int> tris;
+    rewind(faces);
+    readTris(faces, tris, ntris);
+
+    int left = 0;
+    for (unsigned int i = 0; i < lods.size(); i++) {
+        Lod &lod = lods[i];
+        if (lod.done)
+            continue;
+        if (lod.faces < reached) {
+            left++;
+            continue;
+        }
+        Snapshot *s = new Snapshot;
+        s->path = lod.path;
+        s->verts = verts;
+        s->tris = tris;
+        fprintf(stderr, "%s: %ld faces, out of core\n", lod.path.c_str(), ntris);
+        queueSnapshot(writer, s);
+        lod.done = true;
+    }
+    return left;
+}
+
+/* Append comma-separated numbers in arg to lods as faces, ratios or
+ * errors depending on kind. */
+static bool
+parseLods(char kind, char *arg, vector<Lod> &lods) {
+    for (char *tok = strtok(arg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        Lod lod = { -1.0, -1, DBL_MAX, "", false };
+        double x = atof(tok);
+        if (kind == 'f')
+            lod.faces = atoi(tok);
+        else if (kind == 'r')
+            lod.ratio = x;
+        else
+            lod.error = x;
+        if (x <= 0.0 && !(kind == 'f' && x == 0.0))
+            return false;
+        lods.push_back(lod);
+    }
+    return true;
+}
+
+/* output.off -> output.<i>.off */
+static string
+lodPath(const char *output, int i) {
+    string path(output);
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), ".%d", i);
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot == string::npos || (slash != string::npos && dot < slash))
+        dot = path.size();
+    return path.insert(dot, suffix);
+}
+
+/* A grid of chunks over a bounding box, shifted by `shift` chunks. */
+struct ChunkGrid {
+    vec3 lo, size;
+    int n;
+    float shift;
+
+    /* the chunk holding triangle t's centroid */
+    int Chunk(vector<vec3> &verts, vector<int> &tris, int t) {
+        vec3 c = (verts[tris[3*t]] + verts[tris[3*t+1]] + verts[tris[3*t+2]]) / 3.0f;
+        vec3 g = (c - lo) / size + vec3(shift);
+        int chunk = 0;
+        for (int k = 0; k < 3; k++)
+            chunk = chunk * n + std::max(0, std::min(n - 1, (int) g[k]));
+        return chunk;
+    }
+};
+
+/*
+ * One out-of-core round. Takes ntris triangles over verts from faces and
+ * replaces both with the stitched result of simplifying each chunk of a
+ * grid x grid x grid split of the bounding box, shifted by `shift` chunks.
+ */
+static void
+simplifyChunks(vector<vec3> &verts, FILE *&faces, long &ntris, double ratio,
+        int grid, float shift) {
+    ChunkGrid cg;
+    cg.lo = vec3( FLT_MAX);
+    vec3 hi(-FLT_MAX);
+    for (unsigned int i = 0; i < verts.size(); i++) {
+        cg.lo = glm::min(cg.lo, verts[i]);
+        hi = glm::max(hi, verts[i]);
+    }
+    cg.size = glm::max((hi - cg.lo) / (float) grid, vec3(FLT_MIN));
+    cg.n = grid;
+    cg.shift = shift;
+
+    /* count faces by chunk and find the vertices chunks share */
+    int nchunks = grid * grid * grid;
+    vector<long> counts(nchunks, 0);
+    vector<int> owner(verts.size(), UNSEEN);
+
+    rewind(faces);
+    vector<int> tris;
+    for (long done = 0; done < ntris; ) {
+        int n = std::min(ntris - done, (long) 1 << 20);
+        readTris(faces, tris, n);
+        done += n;
+
+        for (int t = 0; t < n; t++) {
+            int chunk = cg.Chunk(verts, tris, t);
+            counts[chunk]++;
+            for (int k = 0; k < 3; k++) {
+                int &o = owner[tris[3*t+k]];
+                if (o == UNSEEN)
+                    o = chunk;
+                else if (o != chunk)
+                    o = SHARED;
+            }
+        }
+    }
+
+    /* then lay them out chunk after chunk in one file, a block at a time */
+    vector<long> start(nchunks + 1, 0), cursor;
+    for (int chunk = 0; chunk < nchunks; chunk++)
+        start[chunk+1] = start[chunk] + counts[chunk];
+    cursor = start;
+
+    FILE *buckets = spill();
+    rewind(faces);
+    vector< pair<int,int> > order; // chunk, triangle
+    vector<int> run;
+    for (long done = 0; done < ntris; ) {
+        int n = std::min(ntris - done, (long) 1 << 20);
+        readTris(faces, tris, n);
+        done += n;
+
+        order.resize(n);
+        for (int t = 0; t < n; t++)
+            order[t] = make_pair(cg.Chunk(verts, tris, t), t);
+        sort(order.begin(), order.end());
+
+        for (int i = 0; i < n; ) {
+            int chunk = order[i].first;
+            run.clear();
+            for (; i < n && order[i].first == chunk; i++)
+                run.insert(run.end(), &tris[3*order[i].second], &tris[3*order[i].second+3]);
+            fseek(buckets, 3 * sizeof(int) * cursor[chunk], SEEK_SET);
+            writeTris(buckets, run);
+            cursor[chunk] += run.size() / 3;
+        }
+    }
+    fclose(faces);
+
+    /* simplify each chunk with its shared vertices locked, and stitch */
+    vector<vec3> stitched;
+    map<int,int> seam; // input index of a shared vertex -> stitched index
+    FILE *out = spill();
+    long nout = 0;
+
+    for (int chunk = 0; chunk < nchunks; chunk++) {
+        if (counts[chunk] == 0)
+            continue;
+
+        fseek(buckets, 3 * sizeof(int) * start[chunk], SEEK_SET);
+        readTris(buckets, tris, counts[chunk]);
+
+        /* pull out just the vertices this chunk uses */
+        vector<int> globals(tris);
+        sort(globals.begin(), globals.end());
+        globals.erase(unique(globals.begin(), globals.end()), globals.end());
+
+        vector<vec3> local(globals.size());
+        for (unsigned int i = 0; i < globals.size(); i++)
+            local[i] = verts[globals[i]];
+        for (unsigned int i = 0; i < tris.size(); i++)
+            tris[i] = lower_bound(globals.begin(), globals.end(), tris[i]) - globals.begin();
+
+        Object *o = new Object(local, tris);
+        foreach(Vertex *v, o->vertices)
+            v->locked = (owner[globals[v->id]] == SHARED);
+        o->Simplify((int) ceil(counts[chunk] * ratio));
+
+        vector<int> ids;
+        o->Export(local, tris, &ids);
+        delete o;
+
+        vector<int> remap(local.size());
+        for (unsigned int i = 0; i < local.size(); i++) {
+            int g = globals[ids[i]];
+            if (owner[g] == SHARED) {
+                map<int,int>::iterator it = seam.find(g);
+                if (it != seam.end()) {
+                    remap[i] = it->second;
+                    continue;
+                }
+                seam[g] = stitched.size();
+            }
+            remap[i] = stitched.size();
+            stitched.push_back(local[i]);
+        }
+
+        for (unsigned int i = 0; i < tris.size(); i++)
+            tris[i] = remap[tris[i]];
+        writeTris(out, tris);
+        nout += tris.size() / 3;
+    }
+    fclose(buckets);
+
+    verts.swap(stitched);
+    faces = out;
+    ntris = nout;
+}
+
+int main(int argc, char *argv[])
+{
+    vector<Lod> lods;
+    long budget = 1024;
+    float weld = -1.0f;
+    bool ok = true;
+    int a = 1;
+    for (; a < argc - 2 && ok; a++) {
+        if ((!strcmp(argv[a], "-f") || !strcmp(argv[a], "-r") || !strcmp(argv[a], "-e"))
+                && a + 1 < argc - 2) {
+            ok = parseLods(argv[a][1], argv[a+1], lods);
+            a++;
+        } else if (!strcmp(argv[a], "-m") && a + 1 < argc - 2)
+            budget = atol(argv[++a]);
+        else if (!strcmp(argv[a], "-w") && a + 1 < argc - 2)
+            weld = atof(argv[++a]);
+        else
+            break;
+    }
+    if (!ok || a != argc - 2 || budget <= 0) {
+        fprintf(stderr, "Usage: %s [-f faces,... | -r ratio,... | -e error,...] "
+                "[-m megabytes] [-w tolerance] input.off output.off\n", argv[0]);
+        exit(1);
+    }
+    if (lods.empty()) {
+        Lod lod = { 0.1, -1, DBL_MAX, "", false };
+        lods.push_back(lod);
+    }
+    budget <<= 20;
+
+    FILE *input = fopen(argv[a], "r");
+    if (input == NULL) {
+        fprintf(stderr, "Unable to open input file: %s\n", argv[a]);
+        exit(2);
+    }
+
+    char header[4];
+    int nverts, nfaces, nedges;
+    if (fscanf(input, "%3s %d %d %d", header, &nverts, &nfaces, &nedges) != 4 ||
+            strcmp(header, "OFF")) {
+        fprintf(stderr, "Not an OFF file: %s\n", argv[a]);
+        exit(3);
+    }
+
+    vector<vec3> verts(nverts);
+    for (int i = 0; i < nverts; i++) {
+        vec3 &v = verts[i];
+        if (fscanf(input, "%f %f %f", &v.x, &v.y, &v.z) != 3) {
+            fprintf(stderr, "Truncated vertex list in mesh file: %s\n", argv[a]);
+            exit(3);
+        }
+    }
+
+    /* faces are renumbered onto the welded vertices as they're read,
+     * noting which vertices they still use */
+    vector<int> remap, used;
+    if (weld >= 0.0f) {
+        WeldVertices(verts, weld, remap);
+        used.assign(verts.size(), 0);
+    }
+
+    /* spill triangles (polygons split into fans) to disk */
+    FILE *faces = spill();
+    long ntris = 0;
+    vector<int> tris;
+    for (int i = 0; i < nfaces; i++) {
+        int valence, i0, i1, i2;
+        if (fscanf(input, "%d %d %d", &valence, &i0, &i1) != 3) {
+            fprintf(stderr, "Truncated face list in mesh file: %s\n", argv[a]);
+            exit(3);
+        }
+        for (int k = 2; k < valence; k++) {
+            if (fscanf(input, "%d", &i2) != 1) {
+                fprintf(stderr, "Truncated face list in mesh file: %s\n", argv[a]);
+                exit(3);
+            }
+            if (i0 < 0 || i1 < 0 || i2 < 0 || i0 >= nverts || i1 >= nverts || i2 >= nverts) {
+                fprintf(stderr, "Bad vertex index in mesh file: %s\n", argv[a]);
+                exit(3);
+            }
+            tris.push_back(i0);
+            tris.push_back(i1);
+            tris.push_back(i2);
+            i1 = i2;
+        }
+        if (tris.size() >= 3 << 20) {
+            if (weld >= 0.0f)
+                remapUsed(tris, remap, used);
+            writeTris(faces, tris);
+            ntris += tris.size() / 3;
+            tris.clear();
+        }
+    }
+    if (weld >= 0.0f)
+        remapUsed(tris, remap, used);
+    writeTris(faces, tris);
+    ntris += tris.size() / 3;
+    fclose(input);
+
+    /* welding can leave vertices no face uses; take them out */
+    if (weld >= 0.0f && DropUnused(verts, used) > 0)
+        remapSpill(faces, ntris, used);
+
+    for (unsigned int i = 0; i < lods.size(); i++) {
+        Lod &lod = lods[i];
+        if (lod.ratio > 0.0)
+            lod.faces = (int) (lod.ratio * ntris);
+        lod.path = (lods.size() == 1) ? string(argv[a+1]) : lodPath(argv[a+1], i);
+    }
+
+    long resident = verts.size() * (sizeof(vec3) + sizeof(int));
+    if (resident >= budget) {
+        fprintf(stderr, "Budget too small to hold the %d vertex positions\n", (int) verts.size());
+        exit(4);
+    }
+
+    SnapshotWriter writer;
+    startWriter(writer);
+
+    /* out of core until what's left fits */
+    for (int round = 0; inCoreBytes(ntris) > budget - resident; round++) {
+        /* rounds must stop short of the most detailed face-count target */
+        int target = 0;
+        for (unsigned int i = 0; i < lods.size(); i++)
+            if (!lods[i].done)
+                target = std::max(target, lods[i].faces);
+
+        if (ntris > target) {
+            long capacity = (budget - resident) / BYTES_PER_FACE;
+            int grid = 1;
+            while ((double) ntris / (grid*grid*grid) > 0.5 * capacity)
+                grid++;
+
+            long before = ntris;
+            double r = std::max((double) target / ntris, 0.5 * capacity / ntris);
+            simplifyChunks(verts, faces, ntris, std::min(1.0, r), grid, (round % 2) ? 0.5f : 0.0f);
+            resident = verts.size() * (sizeof(vec3) + sizeof(int));
+            fprintf(stderr, "round %d: %d^3 chunks, %ld -> %ld faces\n", round, grid, before, ntris);
+
+            /* each chunk's share of the target is rounded up, so a face
+             * per chunk over it is as close as rounds get */
+            if (ntris >= before && ntris > target + grid*grid*grid) {
+                fprintf(stderr, "Unable to simplify below %ld faces within the budget\n", ntris);
+                exit(4);
+            }
+            if (ntris > target && ntris < before)
+                continue;
+        }
+
+        if (writeStitched(verts, faces, ntris, std::min((long) target, ntris), lods, writer) == 0) {
+            fclose(faces);
+            finishWriter(writer);
+            return 0;
+        }
+    }
+
+    /* last pass over everything, seams included */
+    rewind(faces);
+    readTris(faces, tris, ntris);
+    fclose(faces);
+
+    simplifyInCore(verts, tris, lods, writer);
+    finishWriter(writer);
+    return 0;
+}
@@ -0,0 +1,14 @@
+#!/bin/sh
+# A flat model has no quadric error anywhere, so a loose octree tolerance
+# would merge it all into one cell; cluster must still write triangles.
+
+out=$(mktemp)
+trap 'rm -f $out' EXIT
+
+./cluster -r 32 -e 0.001 models/plane.off $out 2>/dev/null || exit 1
+faces=$(sed -n 2p $out | awk '{ print $2 }')
+if [ "$faces" -lt 1 ]; then
+    echo "cluster-plane: plane.off clustered to $faces faces"
+    exit 1
+fi
+echo "cluster-plane: ok ($faces faces)"
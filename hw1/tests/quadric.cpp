@@ -0,0 +1,75 @@
+/*
+ * Checks the AVX Quadric against the plain one on random planes and
+ * points. Built with AVX=1; the same header is pulled in a second time
+ * with AVX hidden to get the plain loops.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#include "Quadric.h"
+
+#ifdef __AVX__
+#define HAVE_AVX 1
+#endif
+
+namespace scalar {
+#undef _QUADRIC_H_
+#undef __AVX__
+#undef MAX_CONDITION
+#include "Quadric.h"
+}
+
+static unsigned int seed = 283;
+static double
+drand() {
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) / (double) (1 << 24) * 2.0 - 1.0;
+}
+
+static bool
+close(double a, double b) {
+    return std::fabs(a - b) <= 1e-9 * std::max(1.0, std::max(std::fabs(a), std::fabs(b)));
+}
+
+int main()
+{
+    int failures = 0;
+    for (int trial = 0; trial < 1000; trial++) {
+        Quadric q, r;
+        scalar::Quadric sq, sr;
+        for (int p = 0; p < 1 + trial % 8; p++) {
+            double a = drand(), b = drand(), c = drand();
+            double len = std::sqrt(a*a + b*b + c*c);
+            a /= len; b /= len; c /= len;
+            double d = drand();
+            if (p % 2) { q.AddPlane(a, b, c, d); sq.AddPlane(a, b, c, d); }
+            else       { r.AddPlane(a, b, c, d); sr.AddPlane(a, b, c, d); }
+        }
+        Quadric sum = q + r;
+        scalar::Quadric ssum = sq + sr;
+
+        double x = drand(), y = drand(), z = drand();
+        double e = sum.Eval(x, y, z), se = ssum.Eval(x, y, z);
+        if (!close(e, se) && failures++ < 10)
+            fprintf(stderr, "quadric: trial %d evaluates to %.17g, not %.17g\n", trial, e, se);
+
+        double mx = 0, my = 0, mz = 0, sx = 0, sy = 0, sz = 0;
+        bool ok = sum.Solve(mx, my, mz), sok = ssum.Solve(sx, sy, sz);
+        if ((ok != sok || (ok && (!close(mx, sx) || !close(my, sy) || !close(mz, sz))))
+                && failures++ < 10)
+            fprintf(stderr, "quadric: trial %d solves differently\n", trial);
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "quadric: %d mismatches\n", failures);
+        return 1;
+    }
+#ifdef HAVE_AVX
+    printf("quadric: ok (AVX against plain)\n");
+#else
+    printf("quadric: ok (plain only; build with AVX=1 to compare)\n");
+#endif
+    return 0;
+}
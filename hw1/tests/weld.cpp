@@ -0,0 +1,135 @@
+/*
+ * Welding joins pieces an exporter split along a seam: the duplicated
+ * vertices merge and the boundary hedges either side pair up. Faces that
+ * weld shut are dropped, and any vertex only they used goes with them.
+ * Checked on two grids written with their shared column duplicated, the
+ * same plus a sliver, and a mesh with no seams, all loaded as the viewer
+ * and batch load them.
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include "Object.h"
+
+using namespace std;
+using namespace glm;
+
+#define TOLERANCE 1e-5f
+
+/* rows of vertices along the seam */
+#define SEAM 4
+
+/* Two 2 x (SEAM-1) quad grids side by side, meeting at x = 2, each with
+ * its own copy of that column; with a sliver, also a far-off triangle
+ * whose last two corners are closer than the tolerance. */
+static FILE*
+seamFixture(bool sliver) {
+    vector<vec3> verts;
+    vector<int> tris;
+    for (int piece = 0; piece < 2; piece++) {
+        int base = verts.size();
+        for (int y = 0; y < SEAM; y++)
+            for (int x = 0; x < 3; x++)
+                verts.push_back(vec3(2 * piece + x, y, 0));
+        for (int y = 0; y + 1 < SEAM; y++) {
+            for (int x = 0; x < 2; x++) {
+                int a = base + 3*y + x, b = a + 1, c = a + 3, d = c + 1;
+                int quad[6] = { a, b, d,  a, d, c };
+                tris.insert(tris.end(), quad, quad + 6);
+            }
+        }
+    }
+    if (sliver) {
+        int base = verts.size();
+        verts.push_back(vec3(10, 0, 0));
+        verts.push_back(vec3(11, 0, 0));
+        verts.push_back(vec3(11, 0, TOLERANCE / 10));
+        int corners[3] = { base, base + 1, base + 2 };
+        tris.insert(tris.end(), corners, corners + 3);
+    }
+
+    FILE *f = tmpfile();
+    fprintf(f, "OFF\n%d %d 0\n", (int) verts.size(), (int) tris.size() / 3);
+    for (unsigned int i = 0; i < verts.size(); i++)
+        fprintf(f, "%g %g %g\n", verts[i].x, verts[i].y, verts[i].z);
+    for (unsigned int i = 0; i < tris.size(); i += 3)
+        fprintf(f, "3 %d %d %d\n", tris[i], tris[i+1], tris[i+2]);
+    rewind(f);
+    return f;
+}
+
+static Object*
+load(FILE *f, float weld) {
+    Object *o = new Object(f, weld);
+    fclose(f);
+    return o;
+}
+
+/* hedges running along the seam without a pair */
+static int
+openSeam(Object *o) {
+    int n = 0;
+    foreach(Hedge *h, o->hedges)
+        if (h->v->dstval.x == 2 && h->oppv()->dstval.x == 2 && h->pair == NULL)
+            n++;
+    return n;
+}
+
+/* how many of o's vertices no face uses */
+static int
+unused(Object *o) {
+    vector<vec3> verts;
+    vector<int> tris;
+    o->Export(verts, tris);
+    vector<bool> used(verts.size(), false);
+    for (unsigned int i = 0; i < tris.size(); i++)
+        used[tris[i]] = true;
+    int n = 0;
+    for (unsigned int i = 0; i < used.size(); i++)
+        n += !used[i];
+    return n;
+}
+
+int main()
+{
+    int failures = 0;
+
+    Object *split = load(seamFixture(false), -1.0f),
+           *welded = load(seamFixture(false), TOLERANCE);
+    int before = split->vertices.size(), after = welded->vertices.size();
+    if (openSeam(split) != 2 * (SEAM - 1) || before - after != SEAM || openSeam(welded) != 0) {
+        printf("weld: seam of %d went from %d to %d vertices, %d -> %d hedges unpaired\n",
+                SEAM, before, after, openSeam(split), openSeam(welded));
+        failures++;
+    }
+    delete split;
+    delete welded;
+
+    Object *sliver = load(seamFixture(true), TOLERANCE);
+    if ((int) sliver->vertices.size() != after || unused(sliver) != 0) {
+        printf("weld: with a sliver, %d vertices (not %d), %d unused\n",
+                (int) sliver->vertices.size(), after, unused(sliver));
+        failures++;
+    }
+    delete sliver;
+
+    /* closed already; welding at seam scale must leave it be */
+    const char *path = "models/bunny-holefilled.off";
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        printf("weld: can't open %s\n", path);
+        return 1;
+    }
+    Object *closed = load(f, TOLERANCE);
+    if (closed->vertices.size() != 35286 || closed->faces.size() != 70568) {
+        printf("weld: %s welded to %d vertices, %d faces\n", path,
+                (int) closed->vertices.size(), (int) closed->faces.size());
+        failures++;
+    }
+    delete closed;
+
+    if (failures == 0)
+        printf("weld: ok (seam of %d closed)\n", SEAM);
+    return failures > 0;
+}
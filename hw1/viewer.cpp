@@ -1,20 +1,36 @@
 #include "viewer.h"
 
 #include <stdlib.h>
+#include <unistd.h>
+#include <cctype>
 #include <cfloat>
+#include <cstring>
 #include <vector>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 
 #include "Object.h"
+#include "Policy.h"
+#include "Simplifier.h"
+#include "MeshBuffer.h"
 #include "extra/gl_hud.h"
 
+#include "glm/gtc/matrix_transform.hpp"
+
 Object *g_model = NULL;
+MeshBuffer *g_buffer = NULL;
+Simplifier *g_simplifier = NULL; /* changes g_model from here on */
 
 int   g_frame = 0,
-      g_animate = 0,
-      g_animateDirection = 0, /* 1: do splits   0: do pops  */
-      g_repeatCount = 0;
+      g_repeatCount = 0,
+      g_bench = 0,
+      g_fullFaces = 0; /* faces as loaded, for seeking */
+
+const char *g_modelName = NULL;
+
+/* --bench runs headless, paced like a 60 Hz display */
+#define BENCH_FRAME_SECONDS (1.0 / 60)
 
 // GUI variables
 int   g_fullscreen=0,
@@ -36,8 +52,9 @@ float g_rotate[2] = {0, 0},
 
 int   g_width = 1024,
       g_height = 1024;
+float g_fovy = 45.0f; /* vertical field of view in degrees */
 
-int   g_qem = 1;
+float g_tolerance = 1.0f; /* pixels of error allowed by view-dependent refinement */
 
 GLhud g_hud;
 
@@ -49,9 +66,22 @@ fitFrame() {
     g_dolly = g_size;
 }
 
+//------------------------------------------------------------------------------
+/* the modelview matrix display() sets up */
+static glm::mat4
+viewMatrix() {
+    glm::mat4 m(1.0f);
+    m = glm::translate(m, glm::vec3(-g_pan[0], -g_pan[1], -g_dolly));
+    m = glm::rotate(m, g_rotate[1], glm::vec3(1, 0, 0));
+    m = glm::rotate(m, g_rotate[0], glm::vec3(0, 1, 0));
+    m = glm::translate(m, glm::vec3(-g_center[0], -g_center[1], -g_center[2]));
+    m = glm::rotate(m, -90.0f, glm::vec3(1, 0, 0)); // z-up model
+    return m;
+}
+
 //------------------------------------------------------------------------------
 static void
-initializeShape(const char* input_filename) {
+initializeShape(const char* input_filename, float weld, bool reorder) {
     printf("Reading object in file %s.\n", input_filename);
 
     FILE* input_file = fopen(input_filename, "r");
@@ -60,8 +90,12 @@ initializeShape(const char* input_filename) {
         exit(2);
     }
 
-    g_model = new Object(input_file);
+    g_model = new Object(input_file, weld, reorder);
+    g_fullFaces = g_model->faces.size();
     g_model->SetCenterSize((float*) &g_center, &g_size);
+    if (!g_bench)
+        g_buffer = new MeshBuffer(); // needs the window's GL context
+    g_simplifier = new Simplifier(g_model);
 
     fclose(input_file);
 
@@ -95,7 +129,7 @@ display() {
     double aspect = g_width/(double)g_height;
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
-    gluPerspective(45.0, aspect, 0.01, 500.0);
+    gluPerspective(g_fovy, aspect, 0.01, 500.0);
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
     glTranslatef(-g_pan[0], -g_pan[1], -g_dolly);
@@ -110,8 +144,12 @@ display() {
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof (GLfloat) * 6, 0);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof (GLfloat) * 6, (float*)12);
 
-    //g_model->DrawPoints();
-    g_model->DrawNormals(g_drawVertexNormals, g_drawFaceNormals);
+    /* whatever the simplifier last finished; it never waits on us */
+    g_simplifier->Update();
+    const Simplifier::Snapshot &snapshot = g_simplifier->Latest();
+
+    //g_buffer->DrawPoints(snapshot);
+    g_buffer->DrawNormals(snapshot, g_drawVertexNormals, g_drawFaceNormals);
 
     glEnable(GL_LIGHTING);
     glShadeModel(GL_SMOOTH);
@@ -125,15 +163,17 @@ display() {
     glMaterialfv(GL_FRONT_AND_BACK, GL_SHININESS, materialShininess);
 
     glPolygonMode(GL_FRONT_AND_BACK, (g_wire == 0) ? GL_LINE : GL_FILL);
-    g_model->Render();
+    g_buffer->Draw(snapshot);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glFinish();
 
     if (g_hud.IsVisible()) {
-        g_hud.DrawString(10, -40,  "Vertices:   %d/%d", g_model->vertices.size(),
-                g_model->vertices.size() + g_model->vsplits.size());
-        g_hud.DrawString(10, -20,  "Faces:      %d", g_model->faces.size());
+        g_hud.DrawString(10, -40,  "Vertices:   %d/%d", snapshot.nvertices,
+                snapshot.nvertices + snapshot.ncollapsed);
+        g_hud.DrawString(10, -20,  "Faces:      %d", snapshot.nfaces);
+        if (snapshot.refining)
+            g_hud.DrawString(10, -60,  "Tolerance:  %.2f px", g_tolerance);
     }
 
     g_hud.Flush();
@@ -179,9 +219,43 @@ mouse(int button, int state, int x, int y) {
     }
 }
 
+//------------------------------------------------------------------------------
+static void
+printPercentiles(const char *label, std::vector<double> times) {
+    if (times.empty())
+        return;
+    std::sort(times.begin(), times.end());
+    double sum = 0;
+    for (unsigned int i = 0; i < times.size(); i++)
+        sum += times[i];
+
+    int n = times.size();
+    printf("%-10s %8.3f %8.3f %8.3f %8.3f %8.3f\n", label,
+            1e3 * sum / n,
+            1e3 * times[n / 2],
+            1e3 * times[std::min(n - 1, (int) (0.9 * n))],
+            1e3 * times[std::min(n - 1, (int) (0.99 * n))],
+            1e3 * times[n - 1]);
+}
+
+/* simplify and snapshot run on the simplifier's thread, frame on ours */
+static void
+benchReport() {
+    g_simplifier->Update();
+    printf("%s: %d frames, %d faces at the end\n", g_modelName,
+            g_repeatCount, g_simplifier->Latest().nfaces);
+    printf("%-10s %8s %8s %8s %8s %8s  (ms)\n", "", "mean", "p50", "p90", "p99", "max");
+    printPercentiles("simplify", g_simplifier->commandTimes);
+    printPercentiles("snapshot", g_simplifier->publishTimes);
+}
+
 //------------------------------------------------------------------------------
 static void
 quit() {
+    if (g_bench) {
+        g_simplifier->Stop(); // let it finish the script
+        benchReport();
+    }
     exit(0);
 }
 
@@ -230,12 +304,24 @@ keyboard(unsigned char key, int x, int y) {
         case 0x1b: g_hud.SetVisible(!g_hud.IsVisible()); break;
 
         /* edge pops */
-        case '-':
-        case '_': g_model->Pop(/* many = */ key == '_'); break;
+        case '-': g_simplifier->Post(Simplifier::POP); break;
+        case '_': g_simplifier->Post(Simplifier::POP_MANY); break;
 
         /* vertex splits */
-        case '=':
-        case '+': g_model->Split(/* many = */ key == '+'); break;
+        case '=': g_simplifier->Post(Simplifier::SPLIT); break;
+        case '+': g_simplifier->Post(Simplifier::SPLIT_MANY); break;
+
+        /* seek: 1-9 to that many tenths of the faces, 0 back to all of them */
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9': {
+            int tenths = (key == '0') ? 10 : key - '0';
+            g_simplifier->Post(Simplifier::SEEK, g_fullFaces * tenths / 10);
+            break;
+        }
+
+        /* view-dependent error tolerance */
+        case '[': g_tolerance *= 0.5f; break;
+        case ']': g_tolerance *= 2.0f; break;
     }
 }
 
@@ -265,13 +351,18 @@ callbackFreeze(bool checked, int f)
 }
 
 static void
-callbackQEM(bool checked, int n) {
-    g_qem = checked;
+callbackPolicy(int c) {
+    g_simplifier->Post(Simplifier::ENGINE, c);
 }
 
 static void
 callbackAnimate(bool checked, int n) {
-    g_animate = checked;
+    g_simplifier->Post(Simplifier::ANIMATE, checked);
+}
+
+static void
+callbackRefine(bool checked, int n) {
+    g_simplifier->Post(Simplifier::REFINE, checked);
 }
 
 static void
@@ -285,8 +376,12 @@ initHUD()
     g_hud.AddRadioButton(1, "Wire (w)",    g_wire == 0, 10, 60, callbackWireframe, 0, 'w');
     g_hud.AddRadioButton(1, "Shaded",      g_wire == 1, 10, 80, callbackWireframe, 1, 'w');
 
-    g_hud.AddCheckBox("Quadrics (m)", true, 10, 110, callbackQEM, 0, 'm');
-    g_hud.AddCheckBox("Animate (a)", 0, 10, 130, callbackAnimate, 0, 'a');
+    g_hud.AddRadioButton(2, "Quadrics (m)", true,  10, 110, callbackPolicy, QEM_OPTIMAL, 'm');
+    g_hud.AddRadioButton(2, "Midpoints",    false, 10, 130, callbackPolicy, QEM_MIDPOINT, 'm');
+    g_hud.AddRadioButton(2, "Edge length",  false, 10, 150, callbackPolicy, EDGE_LENGTH, 'm');
+
+    g_hud.AddCheckBox("Animate (a)", 0, 10, 180, callbackAnimate, 0, 'a');
+    g_hud.AddCheckBox("View-dependent (r)", 0, 10, 200, callbackRefine, 0, 'r');
 }
 
 //------------------------------------------------------------------------------
@@ -314,6 +409,35 @@ initGL()
     glLightfv(GL_LIGHT0, GL_DIFFUSE, diffuse);
 }
 
+//------------------------------------------------------------------------------
+/* --bench script: a quarter of the frames each of many pops, many
+ * splits, single pops and single splits, all with morphs in flight */
+static void
+benchStep() {
+    switch (4 * (g_frame - 1) / g_repeatCount) {
+        case 0: g_simplifier->Post(Simplifier::POP_MANY); break;
+        case 1: g_simplifier->Post(Simplifier::SPLIT_MANY); break;
+        case 2: g_simplifier->Post(Simplifier::POP); break;
+        default: g_simplifier->Post(Simplifier::SPLIT); break;
+    }
+}
+
+/* --bench without a window: each frame posts the script's step and
+ * takes the latest snapshot, as display() would, then waits out the
+ * rest of the frame so morphs stay in flight */
+static void
+runBench() {
+    for (g_frame = 1; g_frame <= g_repeatCount; g_frame++) {
+        double start = MorphClock();
+        benchStep();
+        g_simplifier->Update();
+        double left = BENCH_FRAME_SECONDS - (MorphClock() - start);
+        if (left > 0)
+            usleep((useconds_t) (1e6 * left));
+    }
+    quit();
+}
+
 //------------------------------------------------------------------------------
 static void
 idle() {
@@ -321,30 +445,50 @@ idle() {
     if (not g_freeze)
         g_frame++;
 
-    bool doneAnimating = g_model->Render();
-
-    /* 0: do nothing.   1: do splits   -1: do pops  */
-    if (doneAnimating && g_animate) {
-        if (g_model->vsplits.size() == 0)
-            g_animateDirection = 0;
-        else if (g_model->queue.size() <= 16)
-            g_animateDirection = 1;
-
-        if (g_animateDirection)
-            g_model->Split();
-        else
-            g_model->Pop();
-    }
+    /* for view-dependent refinement; animation runs on its own */
+    g_simplifier->SetView(viewMatrix(), g_fovy, g_width/(float)g_height,
+            g_height, g_tolerance);
 
     glutPostRedisplay();
-
-    if (g_repeatCount != 0 and g_frame >= g_repeatCount)
-        quit();
 }
 
 //------------------------------------------------------------------------------
 int main(int argc, char ** argv)
 {
+    if (argc < 2) {
+        printf("Usage: %s path/to/model.off [--bench [frames]] [--weld tolerance] [--reorder]\n", argv[0]);
+        printf("  --bench runs a scripted pop/split sequence without a window and prints timings\n");
+        exit(1);
+    }
+
+    const char* input_filename = argv[1];
+    float weld = -1.0f; /* off */
+    bool reorder = false;
+    for (int i = 2; i < argc; ++i) {
+        if (!strcmp(argv[i], "--bench")) {
+            g_bench = 1;
+            g_repeatCount = 1000;
+            if (i + 1 < argc && isdigit((unsigned char) argv[i + 1][0]))
+                g_repeatCount = atoi(argv[++i]);
+            if (g_repeatCount <= 0) {
+                printf("Bad frame count for --bench: %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (!strcmp(argv[i], "--weld") && i + 1 < argc) {
+            weld = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--reorder")) {
+            reorder = true;
+        } else {
+            printf("ignoring argument: %s\n", argv[i]);
+        }
+    }
+    g_modelName = input_filename;
+
+    if (g_bench) {
+        initializeShape(input_filename, weld, reorder);
+        runBench();
+    }
+
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_RGBA |GLUT_DOUBLE | GLUT_DEPTH);
     glutInitWindowSize(g_width, g_height);
@@ -355,16 +499,7 @@ int main(int argc, char ** argv)
     glutKeyboardFunc(keyboard);
     glutMotionFunc(motion);
 
-    if (argc < 2) {
-        printf("Usage: %s path/to/model.off\n", argv[0]);
-        exit(1);
-    }
-
-    const char* input_filename = argv[1];
-    for (int i = 2; i < argc; ++i)
-        printf("ignoring argument: %s\n", argv[++i]);
-
-    initializeShape(input_filename);
+    initializeShape(input_filename, weld, reorder);
 
     initGL();
     initHUD();
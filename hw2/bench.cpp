@@ -0,0 +1,326 @@
+/**
+ * Ray tracing benchmark.
+ *
+ *   bench [-o results.json] [-m path/to/models] [-r repeats] [-q]
+ *
+ * Renders the test scenes, synthetic fields of random spheres and the hw1
+ * OFF meshes with both integrators at every thread count from 1 up to the
+ * OpenMP maximum, and writes parse/build times, peak RSS and Mrays/s as
+ * JSON. Each scene runs in a child process so its peak RSS is its own.
+ * Synthetic scenes use a fixed seed so runs are comparable; each timing is
+ * the best of `repeats` renders. -q runs a reduced suite.
+ */
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <climits>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "scene.h"
+#include "timer.h"
+
+using namespace std;
+
+struct BenchScene {
+    BenchScene(string name, string kind, string path, bool temporary) :
+        name(name), kind(kind), path(path), temporary(temporary)
+    {}
+
+    string name, kind, path;
+    bool temporary; // generated scene file, removed after the run
+};
+
+/* deterministic across platforms, unlike rand() */
+static unsigned int bench_seed = 283;
+static float
+frand() {
+    bench_seed = bench_seed * 1664525u + 1013904223u;
+    return (bench_seed >> 8) / (float) (1 << 24);
+}
+
+static FILE*
+tempScene(string &path) {
+    char fname[] = "/tmp/bench-XXXXXX";
+    int fd = mkstemp(fname);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to create temporary scene file\n");
+        exit(2);
+    }
+    path = fname;
+    return fdopen(fd, "w");
+}
+
+static BenchScene
+sphereScene(int n) {
+    string path;
+    FILE *f = tempScene(path);
+
+    fprintf(f, "size 320 240\n");
+    fprintf(f, "camera 0 0 4 0 0 0 0 1 0 45\n");
+    fprintf(f, "directional 1 1 1 .6 .6 .6\n");
+    fprintf(f, "point 0 3 3 .5 .5 .5\n");
+    fprintf(f, "specular .3 .3 .3\nshininess 20\n");
+
+    float r = 0.8f / cbrtf((float) n);
+    for (int i = 0; i < n; i++) {
+        /* draw in a fixed order; argument evaluation order is unspecified */
+        float cr = frand(), cg = frand(), cb = frand();
+        float x = 2*frand()-1, y = 2*frand()-1, z = 2*frand()-1;
+        fprintf(f, "diffuse %f %f %f\n", cr, cg, cb);
+        fprintf(f, "sphere %f %f %f %f\n", x, y, z, r);
+    }
+    fclose(f);
+
+    char name[64];
+    snprintf(name, sizeof(name), "spheres-%d", n);
+    return BenchScene(name, "spheres", path, true);
+}
+
+/* Wrap an OFF mesh in a scene with a camera looking at it from the front
+ * (models are z-up). */
+static bool
+meshScene(string offpath, BenchScene &scene) {
+    FILE *in = fopen(offpath.c_str(), "r");
+    if (in == NULL)
+        return false;
+
+    char header[4];
+    int nverts, nfaces, nedges;
+    if (fscanf(in, "%3s %d %d %d", header, &nverts, &nfaces, &nedges) != 4 ||
+            strcmp(header, "OFF")) {
+        fclose(in);
+        return false;
+    }
+
+    glm::vec3 lo( FLT_MAX), hi(-FLT_MAX);
+    for (int i = 0; i < nverts; i++) {
+        glm::vec3 v;
+        fscanf(in, "%f %f %f", &v.x, &v.y, &v.z);
+        lo = glm::min(lo, v);
+        hi = glm::max(hi, v);
+    }
+    fclose(in);
+    glm::vec3 center = 0.5f * (lo + hi);
+    float size = glm::length(hi - lo);
+
+    char abspath[PATH_MAX];
+    if (realpath(offpath.c_str(), abspath) == NULL)
+        return false;
+
+    string path;
+    FILE *f = tempScene(path);
+    fprintf(f, "size 320 240\n");
+    fprintf(f, "camera %f %f %f %f %f %f 0 0 1 45\n",
+            center.x, center.y - 1.5f*size, center.z + 0.5f*size,
+            center.x, center.y, center.z);
+    fprintf(f, "directional 0 -1 1 .7 .7 .7\n");
+    fprintf(f, "diffuse .6 .5 .4\n");
+    fprintf(f, "mesh %s\n", abspath);
+    fclose(f);
+
+    string name = offpath.substr(offpath.rfind('/') + 1);
+    scene = BenchScene(name, "mesh", path, true);
+    return true;
+}
+
+static vector<string>
+listDir(string dir, string suffix) {
+    vector<string> files;
+    DIR *d = opendir(dir.c_str());
+    if (d == NULL)
+        return files;
+
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        string fname(entry->d_name);
+        if (fname.size() > suffix.size() &&
+                fname.compare(fname.size() - suffix.size(), suffix.size(), suffix) == 0)
+            files.push_back(dir + "/" + fname);
+    }
+    closedir(d);
+    sort(files.begin(), files.end());
+    return files;
+}
+
+/* Everything in a scene's entry but its peak RSS. */
+static void
+runScene(FILE *out, BenchScene &bs, vector<int> &threads, int repeats) {
+    Scene *s = new Scene((char*) bs.path.c_str());
+
+    fprintf(out, "      \"name\": \"%s\",\n", bs.name.c_str());
+    fprintf(out, "      \"kind\": \"%s\",\n", bs.kind.c_str());
+    fprintf(out, "      \"objects\": %d,\n", s->NumObjects());
+    fprintf(out, "      \"width\": %d,\n", s->width);
+    fprintf(out, "      \"height\": %d,\n", s->height);
+    fprintf(out, "      \"cameras\": %d,\n", (int) s->cameras.size());
+    fprintf(out, "      \"parse_s\": %.6f,\n", s->parseTime);
+    fprintf(out, "      \"build_s\": %.6f,\n", s->buildTime);
+    fprintf(out, "      \"runs\": [");
+
+    const char *integrators[] = { "whitted", "wavefront" };
+    bool firstrun = true;
+    for (int w = 0; w < 2; w++) {
+        for (unsigned int t = 0; t < threads.size(); t++) {
+#ifdef _OPENMP
+            omp_set_num_threads(threads[t]);
+#endif
+            double best = 1e30;
+            for (int r = 0; r < repeats; r++) {
+                double start = Now();
+                if (w == 0)
+                    s->RayTrace(false);
+                else
+                    s->WavefrontTrace(false);
+                best = std::min(best, Now() - start);
+            }
+
+            fprintf(out, "%s\n        { \"integrator\": \"%s\", \"threads\": %d, "
+                    "\"seconds\": %.6f, \"rays\": %ld, \"mrays_per_s\": %.4f }",
+                    firstrun ? "" : ",", integrators[w], threads[t],
+                    best, s->raysTraced, s->raysTraced / best * 1e-6);
+            firstrun = false;
+        }
+    }
+
+    fprintf(out, "\n      ],\n");
+
+    delete s;
+}
+
+/* Run a scene in a child process and write its entry. Returns false if it
+ * didn't finish. */
+static bool
+forkScene(FILE *out, BenchScene &bs, vector<int> &threads, int repeats, bool first) {
+    fprintf(stderr, "bench: %s\n", bs.name.c_str());
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        fprintf(stderr, "Unable to create pipe\n");
+        exit(2);
+    }
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Unable to fork\n");
+        exit(2);
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        FILE *entry = fdopen(fds[1], "w");
+        runScene(entry, bs, threads, repeats);
+        _exit(fclose(entry) == 0 ? 0 : 1);
+    }
+
+    close(fds[1]);
+    string entry;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0)
+        entry.append(buf, n);
+    close(fds[0]);
+
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    if (bs.temporary)
+        unlink(bs.path.c_str());
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "bench: %s failed\n", bs.name.c_str());
+        return false;
+    }
+
+#if defined(__APPLE__)
+    long peak_rss_kb = usage.ru_maxrss / 1024;
+#else
+    long peak_rss_kb = usage.ru_maxrss;
+#endif
+    fprintf(out, "%s    {\n", first ? "" : ",\n");
+    fputs(entry.c_str(), out);
+    fprintf(out, "      \"peak_rss_kb\": %ld\n", peak_rss_kb);
+    fprintf(out, "    }");
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *outname = NULL;
+    string modeldir = "../hw1/models";
+    int repeats = 3;
+    bool quick = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            outname = argv[++i];
+        else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+            modeldir = argv[++i];
+        else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+            repeats = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-q"))
+            quick = true;
+        else {
+            fprintf(stderr, "Usage: %s [-o results.json] [-m path/to/models] [-r repeats] [-q]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    FILE *out = stdout;
+    if (outname != NULL && (out = fopen(outname, "w")) == NULL) {
+        fprintf(stderr, "Unable to open output file: %s\n", outname);
+        exit(2);
+    }
+
+    vector<int> threads;
+    int maxthreads = 1;
+#ifdef _OPENMP
+    maxthreads = omp_get_max_threads();
+#endif
+    for (int t = 1; t < maxthreads; t *= 2)
+        threads.push_back(t);
+    threads.push_back(maxthreads);
+
+    vector<BenchScene> scenes;
+    vector<string> tests = listDir("testscenes", ".test");
+    for (unsigned int i = 0; i < tests.size(); i++)
+        scenes.push_back(BenchScene(tests[i].substr(tests[i].rfind('/') + 1), "testscene", tests[i], false));
+
+    int nspheres[] = { 100, 1000, 10000, 100000 };
+    for (int i = 0; i < (quick ? 2 : 4); i++)
+        scenes.push_back(sphereScene(nspheres[i]));
+
+    vector<string> models = listDir(modeldir, ".off");
+    for (unsigned int i = 0; i < models.size() && !(quick && i >= 2); i++) {
+        BenchScene bs("", "", "", false);
+        if (meshScene(models[i], bs))
+            scenes.push_back(bs);
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"max_threads\": %d,\n", maxthreads);
+    fprintf(out, "  \"repeats\": %d,\n", repeats);
+    fprintf(out, "  \"scenes\": [\n");
+    int written = 0;
+    for (unsigned int i = 0; i < scenes.size(); i++)
+        if (forkScene(out, scenes[i], threads, repeats, written == 0))
+            written++;
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout)
+        fclose(out);
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "bvh.h"
+
+#define BVH_LEAF_SIZE 4
+
+using namespace glm;
+
+struct CentroidLess {
+    CentroidLess(std::vector<vec3> &los, std::vector<vec3> &his, int axis) :
+        los(los), his(his), axis(axis)
+    {}
+    bool operator() (int a, int b) const {
+        return los[a][axis] + his[a][axis] < los[b][axis] + his[b][axis];
+    }
+
+    std::vector<vec3> &los, &his;
+    int axis;
+};
+
+/* los/his are the bounds of each primitive, indexed like the owner's. */
+void
+BVH::Build(std::vector<vec3> &los, std::vector<vec3> &his) {
+    int n = los.size();
+
+    prims.resize(n);
+    for (int i = 0; i < n; i++)
+        prims[i] = i;
+
+    nodes.clear();
+    nodes.reserve(2 * n);
+    if (n > 0)
+        BuildNode(0, n, los, his);
+}
+
+/* Median split along the longest axis of the centroid bounds. Children are
+ * laid out depth-first, so the left child always follows its parent. */
+int
+BVH::BuildNode(int begin, int end, std::vector<vec3> &los, std::vector<vec3> &his) {
+    int idx = nodes.size();
+    nodes.push_back(BVHNode());
+
+    vec3 lo( FLT_MAX), hi(-FLT_MAX),
+         clo( FLT_MAX), chi(-FLT_MAX);
+    for (int i = begin; i < end; i++) {
+        int p = prims[i];
+        lo = min(lo, los[p]);
+        hi = max(hi, his[p]);
+        vec3 c = 0.5f * (los[p] + his[p]);
+        clo = min(clo, c);
+        chi = max(chi, c);
+    }
+    nodes[idx].lo = lo;
+    nodes[idx].hi = hi;
+
+    vec3 extent = chi - clo;
+    int axis = (extent.x > extent.y) ? 0 : 1;
+    if (extent.z > extent[axis])
+        axis = 2;
+
+    if (end - begin <= BVH_LEAF_SIZE || extent[axis] <= 0.0f) {
+        nodes[idx].first = begin;
+        nodes[idx].count = end - begin;
+        return idx;
+    }
+
+    int mid = (begin + end) / 2;
+    std::nth_element(prims.begin() + begin, prims.begin() + mid, prims.begin() + end,
+            CentroidLess(los, his, axis));
+
+    BuildNode(begin, mid, los, his);
+    int right = BuildNode(mid, end, los, his);
+    nodes[idx].first = right;
+    nodes[idx].count = 0;
+    return idx;
+}
@@ -0,0 +1,112 @@
+#ifndef _TRACE_BVH_H_
+#define _TRACE_BVH_H_
+
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "ray.h"
+
+#define BVH_STACK_SIZE 64
+
+class BVHNode {
+  public:
+    glm::vec3 lo, hi;
+    int first;  // right child for interior nodes, first prim for leaves
+    int count;  // number of prims in a leaf, 0 for interior nodes
+};
+
+/*
+ * Bounding volume hierarchy over an indexed set of primitives. It only
+ * stores indices; traversal calls back into the owner of the primitives,
+ * which must provide
+ *
+ *     bool IntersectPrim(int i, Ray &ray, Hit &hit);
+ *
+ * returning true (and updating hit.t and hit.normal) only for hits closer
+ * than hit.t.
+ */
+class BVH {
+  public:
+    void Build(std::vector<glm::vec3> &los, std::vector<glm::vec3> &his);
+    template <class P> bool Intersect(P &owner, Ray &ray, Hit &hit);
+    template <class P> bool Occluded(P &owner, Ray &ray, float tmax);
+
+  private:
+    int BuildNode(int begin, int end, std::vector<glm::vec3> &los, std::vector<glm::vec3> &his);
+
+    std::vector<BVHNode> nodes;
+    std::vector<int> prims;
+};
+
+static inline bool
+hitBox(glm::vec3 &lo, glm::vec3 &hi, glm::vec3 &origin, glm::vec3 &invdir, float tmax) {
+    glm::vec3 t0 = (lo - origin) * invdir,
+              t1 = (hi - origin) * invdir;
+    glm::vec3 tn = glm::min(t0, t1),
+              tf = glm::max(t0, t1);
+    float enter = std::max(std::max(tn.x, tn.y), std::max(tn.z, 0.0f)),
+          exit  = std::min(std::min(tf.x, tf.y), std::min(tf.z, tmax));
+    return enter <= exit;
+}
+
+template <class P> bool
+BVH::Intersect(P &owner, Ray &ray, Hit &hit) {
+    if (nodes.empty())
+        return false;
+
+    glm::vec3 invdir = 1.0f / ray.direction;
+    int stack[BVH_STACK_SIZE], top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        BVHNode &node = nodes[stack[--top]];
+        if (!hitBox(node.lo, node.hi, ray.origin, invdir, hit.t))
+            continue;
+
+        if (node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = &node - &nodes[0] + 1;
+            continue;
+        }
+
+        for (int i = node.first; i < node.first + node.count; i++)
+            if (owner.IntersectPrim(prims[i], ray, hit))
+                hit.obj = prims[i];
+    }
+
+    return hit.obj >= 0;
+}
+
+template <class P> bool
+BVH::Occluded(P &owner, Ray &ray, float tmax) {
+    Hit hit;
+    hit.t = tmax;
+    if (nodes.empty())
+        return false;
+
+    glm::vec3 invdir = 1.0f / ray.direction;
+    int stack[BVH_STACK_SIZE], top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        BVHNode &node = nodes[stack[--top]];
+        if (!hitBox(node.lo, node.hi, ray.origin, invdir, hit.t))
+            continue;
+
+        if (node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = &node - &nodes[0] + 1;
+            continue;
+        }
+
+        for (int i = node.first; i < node.first + node.count; i++)
+            if (owner.IntersectPrim(prims[i], ray, hit))
+                return true;
+    }
+
+    return false;
+}
+
+#endif /* _TRACE_BVH_H_ */
@@ -8,24 +8,31 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <png.h>
 
 #include <glm/gtx/color_cast.hpp>
 
+static inline png_byte clampByte(float c)
+{
+    return (png_byte) (255 * fmaxf(0.0f, fminf(1.0f, c)) + 0.5f);
+}
+
 void setRGB(png_byte *ptr, glm::vec3 &val)
 {
-    ptr[0] = 255 * val.r;
-    ptr[1] = 255 * val.g;
-    ptr[2] = 255 * val.b;
+    ptr[0] = clampByte(val.r);
+    ptr[1] = clampByte(val.g);
+    ptr[2] = clampByte(val.b);
 }
 
-int writeImage(char* filename, int width, int height, glm::vec3 *buffer, char* title)
+int writeImage(char* filename, int width, int height, glm::vec3 *buffer, char* title, int *region)
 {
 	int code = 0;
-	FILE *fp;
-	png_structp png_ptr;
-	png_infop info_ptr;
-	png_bytep row;
+	FILE *fp = NULL;
+	png_structp png_ptr = NULL;
+	png_infop info_ptr = NULL;
+	png_bytep row = NULL;
+	char region_str[128];
 	
 	// Open file for writing (binary mode)
 	fp = fopen(filename, "wb");
@@ -74,6 +81,17 @@ int writeImage(char* filename, int width, int height, glm::vec3 *buffer, char* t
 		png_set_text(png_ptr, info_ptr, &title_text, 1);
 	}
 
+	// Record where this image sits in the full frame
+	if (region != NULL) {
+		png_text region_text;
+		snprintf(region_str, sizeof(region_str), "%d %d %d %d %d %d",
+				region[0], region[1], region[2], region[3], region[4], region[5]);
+		region_text.compression = PNG_TEXT_COMPRESSION_NONE;
+		region_text.key = (char*) "Region";
+		region_text.text = region_str;
+		png_set_text(png_ptr, info_ptr, &region_text, 1);
+	}
+
 	png_write_info(png_ptr, info_ptr);
 
 	// Allocate memory for one row (3 bytes per pixel - RGB)
@@ -99,3 +117,100 @@ int writeImage(char* filename, int width, int height, glm::vec3 *buffer, char* t
 
 	return code;
 }
+
+int readImage(char* filename, int *width, int *height, glm::vec3 **buffer, int *region)
+{
+	int code = 0;
+	FILE *fp = NULL;
+	png_structp png_ptr = NULL;
+	png_infop info_ptr = NULL;
+	// set after the setjmp, so volatile to survive a longjmp back to it
+	png_bytep volatile row = NULL;
+	glm::vec3 * volatile pixels = NULL;
+	png_textp text;
+	int ntext;
+
+	*buffer = NULL;
+
+	// Open file for reading (binary mode)
+	fp = fopen(filename, "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "Could not open file %s for reading\n", filename);
+		code = 1;
+		goto finalise;
+	}
+
+	// Initialize read structure
+	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (png_ptr == NULL) {
+		fprintf(stderr, "Could not allocate read struct\n");
+		code = 1;
+		goto finalise;
+	}
+
+	// Initialize info structure
+	info_ptr = png_create_info_struct(png_ptr);
+	if (info_ptr == NULL) {
+		fprintf(stderr, "Could not allocate info struct\n");
+		code = 1;
+		goto finalise;
+	}
+
+	// Setup Exception handling
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		fprintf(stderr, "Error during png read of %s\n", filename);
+		code = 1;
+		goto finalise;
+	}
+
+	png_init_io(png_ptr, fp);
+	png_read_info(png_ptr, info_ptr);
+
+	// Normalize whatever is in the file to 8-bit RGB
+	png_set_strip_16(png_ptr);
+	png_set_strip_alpha(png_ptr);
+	png_set_palette_to_rgb(png_ptr);
+	png_set_gray_to_rgb(png_ptr);
+	png_read_update_info(png_ptr, info_ptr);
+
+	*width = png_get_image_width(png_ptr, info_ptr);
+	*height = png_get_image_height(png_ptr, info_ptr);
+
+	// Images without a region cover the whole frame
+	if (region != NULL) {
+		region[0] = 0;
+		region[1] = 0;
+		region[2] = region[4] = *width;
+		region[3] = region[5] = *height;
+		if (png_get_text(png_ptr, info_ptr, &text, &ntext) > 0)
+			for (int i = 0; i < ntext; i++)
+				if (!strcmp(text[i].key, "Region"))
+					sscanf(text[i].text, "%d %d %d %d %d %d",
+							&region[0], &region[1], &region[2],
+							&region[3], &region[4], &region[5]);
+	}
+
+	// Read image data
+	pixels = (glm::vec3*) malloc(*width * *height * sizeof(glm::vec3));
+	row = (png_bytep) malloc(png_get_rowbytes(png_ptr, info_ptr));
+	for (int y=0 ; y<*height ; y++) {
+		png_read_row(png_ptr, row, NULL);
+		for (int x=0 ; x<*width ; x++)
+			pixels[y * *width + x] = glm::vec3(row[x*3+0], row[x*3+1], row[x*3+2]) / 255.0f;
+	}
+
+	png_read_end(png_ptr, NULL);
+
+	finalise:
+	if (fp != NULL) fclose(fp);
+	if (png_ptr != NULL) png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+	if (row != NULL) free(row);
+
+	// only a complete image is handed back
+	if (code == 0)
+		*buffer = pixels;
+	else if (pixels != NULL)
+		free(pixels);
+
+	return code;
+}
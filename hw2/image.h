@@ -3,6 +3,9 @@
 
 #include <glm/glm.hpp>
 
-int writeImage(char* filename, int width, int height, glm::vec3 *buffer, char* title);
+/* region, if given, is {x0, y0, x1, y1, full width, full height} of a crop
+ * window; it is stored in the png so crops can be merged back together. */
+int writeImage(char* filename, int width, int height, glm::vec3 *buffer, char* title, int *region = NULL);
+int readImage(char* filename, int *width, int *height, glm::vec3 **buffer, int *region = NULL);
 
 #endif /* _TRACE_IMAGE_H_ */
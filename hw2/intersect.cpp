@@ -0,0 +1,167 @@
+#include "scene.h"
+
+#include <cmath>
+
+using namespace glm;
+
+static void
+grow(glm::mat4 &xform, vec3 p, vec3 &lo, vec3 &hi) {
+    vec4 tp = xform * vec4(p.x, p.y, p.z, 1.0f);
+    vec3 q(tp.x, tp.y, tp.z);
+    lo = min(lo, q);
+    hi = max(hi, q);
+}
+
+void
+Object::Bounds(vec3 &lo, vec3 &hi) {
+    lo = hi = vec3(xform[3][0], xform[3][1], xform[3][2]);
+}
+
+bool
+Object::IntersectLocal(Ray &, float &, vec3 &) {
+    return false;
+}
+
+/* Intersect in object space, then carry the normal back with the inverse
+ * transpose. The direction is not renormalized so t is the same in both. */
+bool
+Object::Intersect(Ray &ray, Hit &hit) {
+    vec4 o = ixform * vec4(ray.origin.x, ray.origin.y, ray.origin.z, 1.0f),
+         d = ixform * vec4(ray.direction.x, ray.direction.y, ray.direction.z, 0.0f);
+    Ray local(vec3(o.x, o.y, o.z), vec3(d.x, d.y, d.z));
+
+    float t;
+    vec3 n;
+    if (!IntersectLocal(local, t, n) || t >= hit.t)
+        return false;
+
+    vec4 tn = vec4(n.x, n.y, n.z, 0.0f);
+    vec3 wn( dot(ixform[0], tn), dot(ixform[1], tn), dot(ixform[2], tn) );
+    hit.t = t;
+    hit.normal = wn;
+    return true;
+}
+
+void
+Sphere::Bounds(vec3 &lo, vec3 &hi) {
+    lo = vec3( FLT_MAX);
+    hi = vec3(-FLT_MAX);
+    for (int c = 0; c < 8; c++)
+        grow(xform, vec3((c&1) ? r : -r, (c&2) ? r : -r, (c&4) ? r : -r), lo, hi);
+}
+
+bool
+Sphere::IntersectLocal(Ray &ray, float &t, vec3 &normal) {
+    vec3 &o = ray.origin, &d = ray.direction;
+    float a = dot(d, d),
+          b = 2.0f * dot(o, d),
+          c = dot(o, o) - r*r;
+    float disc = b*b - 4.0f*a*c;
+    if (disc < 0.0f)
+        return false;
+
+    float sq = sqrtf(disc);
+    t = (-b - sq) / (2.0f * a);
+    if (t < RAY_EPSILON)
+        t = (-b + sq) / (2.0f * a);
+    if (t < RAY_EPSILON)
+        return false;
+
+    normal = o + t * d;
+    return true;
+}
+
+/* Moller-Trumbore; u and v are the barycentric weights of v1 and v2. */
+static bool
+intersectTri(Ray &ray, vec3 &v0, vec3 &v1, vec3 &v2, float &t, float &u, float &v) {
+    vec3 e1 = v1 - v0,
+         e2 = v2 - v0;
+    vec3 p = cross(ray.direction, e2);
+    float det = dot(e1, p);
+    if (fabsf(det) < 1e-12f)
+        return false;
+
+    float inv = 1.0f / det;
+    vec3 s = ray.origin - v0;
+    u = dot(s, p) * inv;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    vec3 q = cross(s, e1);
+    v = dot(ray.direction, q) * inv;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    t = dot(e2, q) * inv;
+    return t >= RAY_EPSILON;
+}
+
+void
+Tri::Bounds(vec3 &lo, vec3 &hi) {
+    lo = vec3( FLT_MAX);
+    hi = vec3(-FLT_MAX);
+    grow(xform, v0, lo, hi);
+    grow(xform, v1, lo, hi);
+    grow(xform, v2, lo, hi);
+}
+
+bool
+Tri::IntersectLocal(Ray &ray, float &t, vec3 &normal) {
+    float u, v;
+    if (!intersectTri(ray, v0, v1, v2, t, u, v))
+        return false;
+
+    normal = cross(v1-v0, v2-v0);
+    return true;
+}
+
+void
+TriNormal::Bounds(vec3 &lo, vec3 &hi) {
+    lo = vec3( FLT_MAX);
+    hi = vec3(-FLT_MAX);
+    grow(xform, vn0.first, lo, hi);
+    grow(xform, vn1.first, lo, hi);
+    grow(xform, vn2.first, lo, hi);
+}
+
+bool
+TriNormal::IntersectLocal(Ray &ray, float &t, vec3 &normal) {
+    float u, v;
+    if (!intersectTri(ray, vn0.first, vn1.first, vn2.first, t, u, v))
+        return false;
+
+    normal = (1.0f-u-v) * vn0.second + u * vn1.second + v * vn2.second;
+    return true;
+}
+
+void
+Mesh::Bounds(vec3 &lo, vec3 &hi) {
+    vec3 &mlo = this->lo, &mhi = this->hi;
+    lo = vec3( FLT_MAX);
+    hi = vec3(-FLT_MAX);
+    for (int c = 0; c < 8; c++)
+        grow(xform, vec3((c&1) ? mhi.x : mlo.x, (c&2) ? mhi.y : mlo.y, (c&4) ? mhi.z : mlo.z), lo, hi);
+}
+
+bool
+Mesh::IntersectLocal(Ray &ray, float &t, vec3 &normal) {
+    Hit hit;
+    if (!bvh.Intersect(*this, ray, hit))
+        return false;
+
+    t = hit.t;
+    normal = hit.normal;
+    return true;
+}
+
+bool
+Mesh::IntersectPrim(int i, Ray &ray, Hit &hit) {
+    int i0 = tris[3*i], i1 = tris[3*i+1], i2 = tris[3*i+2];
+    float t, u, v;
+    if (!intersectTri(ray, verts[i0], verts[i1], verts[i2], t, u, v) || t >= hit.t)
+        return false;
+
+    hit.t = t;
+    hit.normal = (1.0f-u-v) * norms[i0] + u * norms[i1] + v * norms[i2];
+    return true;
+}
@@ -0,0 +1,68 @@
+/**
+ * Reassemble crop windows written by `trace -c` into a full frame.
+ *
+ *   merge output.png scene.png.0_0_320_480.png scene.png.320_0_640_480.png
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+#include "image.h"
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s output.png region.png [region.png ...]\n", argv[0]);
+        exit(1);
+    }
+
+    int width = -1, height = -1;
+    glm::vec3 *frame = NULL;
+    char *covered = NULL;
+
+    for (int a = 2; a < argc; a++) {
+        int w, h, region[6];
+        glm::vec3 *buffer;
+        if (readImage(argv[a], &w, &h, &buffer, region))
+            exit(2);
+
+        if (frame == NULL) {
+            width = region[4];
+            height = region[5];
+            frame = (glm::vec3*) calloc(width * height, sizeof(glm::vec3));
+            covered = (char*) calloc(width * height, 1);
+        }
+
+        if (region[4] != width || region[5] != height ||
+                region[2] - region[0] != w || region[3] - region[1] != h ||
+                region[0] < 0 || region[1] < 0 || region[2] > width || region[3] > height) {
+            fprintf(stderr, "Region %s does not fit a %dx%d frame\n", argv[a], width, height);
+            exit(3);
+        }
+
+        for (int i = 0; i < h; i++) {
+            int row = (region[1] + i) * width + region[0];
+            memcpy(&frame[row], &buffer[i*w], w * sizeof(glm::vec3));
+            memset(&covered[row], 1, w);
+        }
+
+        free(buffer);
+    }
+
+    int missing = 0;
+    for (int p = 0; p < width * height; p++)
+        missing += !covered[p];
+    if (missing)
+        fprintf(stderr, "warning: %d of %d pixels not covered by any region\n",
+                missing, width * height);
+
+    int code = writeImage(argv[1], width, height, frame, (char*)"Image");
+
+    free(frame);
+    free(covered);
+
+    return code;
+}
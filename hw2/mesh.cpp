@@ -0,0 +1,112 @@
+#include "scene.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace glm;
+
+/* Read an OFF file straight into the flat vertex and index arrays. Faces
+ * with more than three vertices are split into fans. */
+Mesh::Mesh(mat4 xform, MatSpec &material, const char *fname) :
+    Object(xform, material), lo(FLT_MAX), hi(-FLT_MAX)
+{
+    FILE *f = fopen(fname, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Unable to open mesh file: %s\n", fname);
+        exit(2);
+    }
+
+    char header[4];
+    int nverts, nfaces, nedges;
+    if (fscanf(f, "%3s %d %d %d", header, &nverts, &nfaces, &nedges) != 4 ||
+            strcmp(header, "OFF")) {
+        fprintf(stderr, "Not an OFF file: %s\n", fname);
+        exit(3);
+    }
+
+    verts.resize(nverts);
+    for (int i = 0; i < nverts; i++) {
+        vec3 &v = verts[i];
+        if (fscanf(f, "%f %f %f", &v.x, &v.y, &v.z) != 3) {
+            fprintf(stderr, "Truncated vertex list in mesh file: %s\n", fname);
+            exit(3);
+        }
+        lo = min(lo, v);
+        hi = max(hi, v);
+    }
+
+    tris.reserve(3 * nfaces);
+    for (int i = 0; i < nfaces; i++) {
+        int valence, i0, i1, i2;
+        if (fscanf(f, "%d %d %d", &valence, &i0, &i1) != 3) {
+            fprintf(stderr, "Truncated face list in mesh file: %s\n", fname);
+            exit(3);
+        }
+        for (int k = 2; k < valence; k++) {
+            if (fscanf(f, "%d", &i2) != 1) {
+                fprintf(stderr, "Truncated face list in mesh file: %s\n", fname);
+                exit(3);
+            }
+            if (i0 < 0 || i1 < 0 || i2 < 0 || i0 >= nverts || i1 >= nverts || i2 >= nverts) {
+                fprintf(stderr, "Bad vertex index in mesh file: %s\n", fname);
+                exit(3);
+            }
+            tris.push_back(i0);
+            tris.push_back(i1);
+            tris.push_back(i2);
+            i1 = i2;
+        }
+    }
+    fclose(f);
+
+    ComputeNormals();
+}
+
+void
+Mesh::Build() {
+    int ntris = tris.size() / 3;
+    std::vector<vec3> tlo(ntris), thi(ntris);
+    #pragma omp parallel for
+    for (int i = 0; i < ntris; i++) {
+        vec3 &a = verts[tris[3*i]], &b = verts[tris[3*i+1]], &c = verts[tris[3*i+2]];
+        tlo[i] = min(a, min(b, c));
+        thi[i] = max(a, max(b, c));
+    }
+    bvh.Build(tlo, thi);
+}
+
+/* Area-weighted vertex normals. Face normals are computed in parallel, then
+ * each vertex gathers from its incident faces through a vertex->face index
+ * so no two threads write the same normal. */
+void
+Mesh::ComputeNormals() {
+    int nverts = verts.size(),
+        ntris = tris.size() / 3;
+
+    std::vector<vec3> fnorms(ntris);
+    #pragma omp parallel for
+    for (int i = 0; i < ntris; i++) {
+        vec3 &a = verts[tris[3*i]], &b = verts[tris[3*i+1]], &c = verts[tris[3*i+2]];
+        fnorms[i] = cross(b - a, c - a);
+    }
+
+    std::vector<int> start(nverts + 1, 0), incident(tris.size());
+    for (int k = 0; k < (int) tris.size(); k++)
+        start[tris[k] + 1]++;
+    for (int v = 0; v < nverts; v++)
+        start[v + 1] += start[v];
+    std::vector<int> fill(start.begin(), start.end() - 1);
+    for (int k = 0; k < (int) tris.size(); k++)
+        incident[fill[tris[k]]++] = k / 3;
+
+    norms.resize(nverts);
+    #pragma omp parallel for
+    for (int v = 0; v < nverts; v++) {
+        vec3 n(0.0f);
+        for (int k = start[v]; k < start[v + 1]; k++)
+            n += fnorms[incident[k]];
+        float len = length(n);
+        norms[v] = (len > 0.0f) ? n / len : vec3(0.0f, 0.0f, 1.0f);
+    }
+}
@@ -7,6 +7,7 @@
 using namespace glm;
 
 Scene *scene = NULL;
+mat4 view;
 
 void
 Object::Render() {
@@ -17,7 +18,8 @@ Object::Render() {
     glMaterialfv(GL_FRONT_AND_BACK, GL_EMISSION, &material.emission[0]);
     glMaterialfv(GL_FRONT_AND_BACK, GL_SHININESS, &material.shininess);
 
-    glLoadMatrixf( (const float *) &xform[0] );
+    mat4 modelview = view * xform;
+    glLoadMatrixf( (const float *) &modelview[0] );
 }
 
 void
@@ -55,9 +57,21 @@ TriNormal::Render() {
     glEnd();
 }
 
+void
+Mesh::Render() {
+    this->Object::Render();
+    glBegin(GL_TRIANGLES);
+    for (unsigned int k = 0; k < tris.size(); k++) {
+        glNormal3fv( &norms[tris[k]].x );
+        glVertex3fv( &verts[tris[k]].x );
+    }
+    glEnd();
+}
+
 void
 Light::Init() {
-    glLoadMatrixf( (const float *) &xform[0] );
+    mat4 modelview = view * xform;
+    glLoadMatrixf( (const float *) &modelview[0] );
 
     GLenum n = GL_LIGHT0 + lnum;
 
@@ -78,6 +92,11 @@ Scene::Render() {
     if (width > 100 || height > 100)
         return;
 
+    glm::vec3 eye = cameras[0].eye,
+              center = cameras[0].center,
+              up = cameras[0].up;
+    float fov = cameras[0].fov;
+
     float aspect = width / (float) height;
     float dj = glm::length(center-eye) * tan(0.5 * fov);
     float di = dj / aspect;
@@ -150,7 +169,7 @@ void reshape (int w, int h)
     glViewport (0, 0, (GLsizei) w, (GLsizei) h);
     glMatrixMode (GL_PROJECTION);
     glLoadIdentity ();
-    gluPerspective(scene->fov, (GLfloat) w/(GLfloat) h, 0.5, 100.0);
+    gluPerspective(scene->cameras[0].fov, (GLfloat) w/(GLfloat) h, 0.5, 100.0);
     glMatrixMode (GL_MODELVIEW);
 }
 
@@ -165,6 +184,7 @@ void keyboard(unsigned char key, int x, int y) {
 void
 Scene::Preview() {
     scene = this;
+    view = lookAt(cameras[0].eye, cameras[0].center, cameras[0].up);
 
     int argc = 0;
     glutInit(&argc, NULL);
@@ -0,0 +1,29 @@
+#ifndef _TRACE_RAY_H_
+#define _TRACE_RAY_H_
+
+#include <cfloat>
+
+#include <glm/glm.hpp>
+
+#define RAY_EPSILON 1e-4f
+
+class Ray {
+  public:
+    Ray() {}
+    Ray(glm::vec3 origin, glm::vec3 direction) :
+        origin(origin), direction(direction)
+    {}
+
+    glm::vec3 origin, direction;
+};
+
+class Hit {
+  public:
+    Hit() : t(FLT_MAX), obj(-1) {}
+
+    float t;          // ray parameter of the closest intersection
+    int obj;          // index of the primitive hit, -1 if nothing was hit
+    glm::vec3 normal; // unnormalized, in the same space as the ray
+};
+
+#endif /* _TRACE_RAY_H_ */
@@ -1,8 +1,11 @@
 #include "scene.h"
 #include "image.h"
+#include "timer.h"
 
 #include <cstdio>
 #include <cstdlib>
+#include <cmath>
+#include <algorithm>
 
 #define MAX_LINE_LENGTH 1024
 
@@ -16,7 +19,9 @@ XF(std::vector<glm::mat4> &xforms) {
     return xf;
 }
 
-Scene::Scene(char *scenefilename) : output_fname("scene.png") {
+Scene::Scene(char *scenefilename) : maxdepth(5), raysTraced(0), output_fname("scene.png") {
+    double start = Now();
+
     FILE* sfile = fopen(scenefilename, "r");
     if (sfile == NULL) {
         fprintf(stderr, "Unable to open scene file: %s\n", scenefilename);
@@ -62,11 +67,13 @@ Scene::Scene(char *scenefilename) : output_fname("scene.png") {
             output_fname = string(buf);
 
         } else if (cmd == "camera") {
+            glm::vec3 eye, center, up;
+            float fov;
             fscanf(sfile, "%f %f %f %f %f %f %f %f %f %f",
                     &eye.x, &eye.y, &eye.z,
                     &center.x, &center.y, &center.z,
                     &up.x, &up.y, &up.z, &fov);
-            xforms.push_back( glm::lookAt(eye,center,up) );
+            cameras.push_back( Camera(eye, center, up, fov) );
 
         } else if (cmd == "sphere") {
             float r;
@@ -110,6 +117,19 @@ Scene::Scene(char *scenefilename) : output_fname("scene.png") {
                     vertnorms[i0], vertnorms[i1], vertnorms[i2]);
             objs.push_back(t);
 
+        } else if (cmd == "mesh") {
+            fscanf(sfile, "%s", buf);
+            string fname(buf);
+            if (fname[0] != '/') {
+                // relative to the directory holding the scene file
+                string dir(scenefilename);
+                size_t slash = dir.rfind('/');
+                if (slash != string::npos)
+                    fname = dir.substr(0, slash + 1) + fname;
+            }
+            Mesh *m = new Mesh(XF(xforms), material, fname.c_str());
+            objs.push_back(m);
+
         } else if (cmd == "translate") {
             glm::vec3 v;
             fscanf(sfile, "%f %f %f", &v.x, &v.y, &v.z);
@@ -178,44 +198,170 @@ Scene::Scene(char *scenefilename) : output_fname("scene.png") {
     }
 
     fclose(sfile);
+
+    if (cameras.empty()) {
+        fprintf(stderr, "No camera in scene file: %s\n", scenefilename);
+        exit(3);
+    }
+
+    SetCrop(0, 0, width, height);
+    parseTime = Now() - start;
+
+    start = Now();
+    std::vector<glm::vec3> los(objs.size()), his(objs.size());
+    for (int i = 0; i < (int) objs.size(); i++) {
+        objs[i]->Build();
+        objs[i]->Bounds(los[i], his[i]);
+    }
+    bvh.Build(los, his);
+    buildTime = Now() - start;
 }
 
-glm::vec3
-Scene::CastRay(glm::vec3 origin, glm::vec3 target) {
-    return glm::vec3(1, 0, 0);
+Scene::~Scene() {
+    foreach (Object *obj, objs)
+        delete obj;
+    foreach (Light *light, lights)
+        delete light;
+}
+
+bool
+Scene::SetCrop(int x0, int y0, int x1, int y1) {
+    crop[0] = std::max(0, std::min(x0, width));
+    crop[1] = std::max(0, std::min(y0, height));
+    crop[2] = std::max(crop[0], std::min(x1, width));
+    crop[3] = std::max(crop[1], std::min(y1, height));
+    return crop[2] > crop[0] && crop[3] > crop[1];
 }
 
-void
-Scene::RayTrace() {
-    printf("raytracing...\n");
-    glm::vec3 *buffer = (glm::vec3*) malloc(width * height * sizeof(glm::vec3));
+/* With several cameras each frame goes to <output>-cameraN.png. A cropped
+ * render goes to <output>.x0_y0_x1_y1.png, tagged with its place in the
+ * full frame so merge can reassemble it. */
+bool
+Scene::WriteImage(glm::vec3 *buffer, int camera) {
+    int cw = crop[2] - crop[0],
+        ch = crop[3] - crop[1];
+
+    char suffix[64];
+    string fname = output_fname;
+    if (cameras.size() > 1) {
+        snprintf(suffix, sizeof(suffix), "-camera%d", camera + 1);
+        fname += suffix;
+    }
+
+    if (cw == width && ch == height) {
+        return writeImage((char*)(fname+".png").c_str(), width, height, buffer, (char*)"Image") == 0;
+    }
+
+    snprintf(suffix, sizeof(suffix), ".%d_%d_%d_%d.png", crop[0], crop[1], crop[2], crop[3]);
+    int region[6] = { crop[0], crop[1], crop[2], crop[3], width, height };
+    return writeImage((char*)(fname+suffix).c_str(), cw, ch, buffer, (char*)"Image", region) == 0;
+}
 
+Ray
+Scene::PrimaryRay(Camera &cam, int i, int j) {
     float aspect = width / (float) height;
-    float dj = glm::length(center-eye) * tan(0.5 * fov);
-    float di = dj / aspect;
-    glm::vec3 vj = dj * glm::normalize( glm::cross(center-eye, up) );
-    glm::vec3 vi = di * glm::normalize( up );
-
-    glm::vec3 ur = center + glm::vec3(1.00) * (vi + vj),
-              ul = center + glm::vec3(1.00) * (vi - vj),
-              lr = center + glm::vec3(1.00) * (-vi + vj),
-              ll = center + glm::vec3(1.00) * (-vi - vj);
-    float pix_width  = 2.0f * dj / (float) width;
-    float pix_height = 2.0f * di / (float) height;
-
-    for (int i = 0; i < height; i += 1) {
-        for (int j = 0; j < width; j += 1) {
-            glm::vec3 ulp = ul +
-                glm::vec3(i/(float)height) * (lr-ur) +
-                glm::vec3(j/(float)width ) * (ur-ul);
-            glm::vec3 urp = ulp + pix_width * glm::normalize(vj),
-                      llp = ulp - pix_height * glm::normalize(vi),
-                      lrp = ulp + (urp-ulp) + (llp-ulp);
-            glm::vec3 target = 0.25f * (ulp + urp + llp + lrp);
-
-            buffer[i*width+j] = CastRay(eye, target);
-        }
+    float ty = tan(0.5f * cam.fov * M_PI / 180.0f),
+          tx = ty * aspect;
+    float x = tx * (2.0f * (j + 0.5f) / (float) width - 1.0f),
+          y = ty * (1.0f - 2.0f * (i + 0.5f) / (float) height);
+    return Ray(cam.eye, glm::normalize(x * cam.u + y * cam.v - cam.w));
+}
+
+/* Direct lighting from one light at point p with facing normal n and view
+ * direction v. Returns false if the light is behind the surface; otherwise
+ * fills in the shadow ray that gates the contribution. */
+bool
+Scene::LightRay(Light *light, glm::vec3 p, glm::vec3 n, glm::vec3 v, MatSpec &m,
+        Ray &shadow, float &tmax, glm::vec3 &color) {
+    glm::vec3 l;
+    float atten = 1.0f;
+
+    if (light->tpos.w == 0.0f) {
+        l = glm::normalize(glm::vec3(light->tpos));
+        tmax = FLT_MAX;
+    } else {
+        glm::vec3 d = glm::vec3(light->tpos) / light->tpos.w - p;
+        float dist = glm::length(d);
+        l = d / dist;
+        tmax = dist;
+        glm::vec4 &a = light->material.atten;
+        atten = a.r + a.g * dist + a.b * dist * dist;
+    }
+
+    float ndotl = glm::dot(n, l);
+    if (ndotl <= 0.0f)
+        return false;
+
+    glm::vec3 h = glm::normalize(l + v);
+    float ndoth = std::max(glm::dot(n, h), 0.0f);
+    color = glm::vec3(light->color) / atten *
+        (glm::vec3(m.diffuse) * ndotl + glm::vec3(m.specular) * powf(ndoth, m.shininess));
+    shadow = Ray(p, l);
+    return true;
+}
+
+glm::vec3
+Scene::CastRay(Ray &ray, long &nrays, int depth) {
+    Hit hit;
+    nrays++;
+    if (!bvh.Intersect(*this, ray, hit))
+        return glm::vec3(0.0f);
+
+    MatSpec &m = objs[hit.obj]->material;
+    glm::vec3 p = ray.origin + hit.t * ray.direction,
+              n = glm::normalize(hit.normal),
+              v = -glm::normalize(ray.direction);
+    if (glm::dot(n, v) < 0.0f)
+        n = -n;
+
+    glm::vec3 color = glm::vec3(m.ambient) + glm::vec3(m.emission);
+    foreach (Light *light, lights) {
+        Ray shadow;
+        float tmax;
+        glm::vec3 c;
+        if (!LightRay(light, p, n, v, m, shadow, tmax, c))
+            continue;
+        nrays++;
+        if (!bvh.Occluded(*this, shadow, tmax))
+            color += c;
+    }
+
+    glm::vec3 spec(m.specular);
+    if (depth + 1 < maxdepth && spec != glm::vec3(0.0f)) {
+        Ray reflected(p, glm::reflect(ray.direction, n));
+        color += spec * CastRay(reflected, nrays, depth + 1);
     }
 
-    writeImage((char*)(output_fname+".png").c_str(), width, height, buffer, (char*)"Image");
+    return color;
+}
+
+bool
+Scene::RayTrace(bool save) {
+    if (save)
+        printf("raytracing...\n");
+    int cw = crop[2] - crop[0],
+        ch = crop[3] - crop[1],
+        ncams = cameras.size();
+    glm::vec3 *buffer = (glm::vec3*) malloc(ncams * cw * ch * sizeof(glm::vec3));
+
+    long nrays = 0;
+
+    /* rows of every frame go into one pool so all cameras render at once */
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:nrays)
+    for (int r = 0; r < ncams * ch; r += 1) {
+        Camera &cam = cameras[r / ch];
+        int i = r % ch;
+        for (int j = 0; j < cw; j += 1) {
+            Ray ray = PrimaryRay(cam, crop[1] + i, crop[0] + j);
+            buffer[r*cw+j] = CastRay(ray, nrays);
+        }
+    }
+    raysTraced = nrays;
+
+    bool written = true;
+    if (save)
+        for (int c = 0; c < ncams; c++)
+            written &= WriteImage(&buffer[c*cw*ch], c);
+    free(buffer);
+    return written;
 }
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <stack>
+#include <cfloat>
 
 #include <boost/foreach.hpp>
 #define foreach BOOST_FOREACH
@@ -11,6 +12,9 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "ray.h"
+#include "bvh.h"
+
 typedef std::pair<glm::vec3,glm::vec3> vertnorm;
 
 class MatSpec {
@@ -20,7 +24,8 @@ class MatSpec {
         ambient  ( glm::vec4(0.2f, 0.2f, 0.2f, 0.0f) ),
         diffuse  ( glm::vec4(0.2f, 0.2f, 0.2f, 1.0f) ),
         specular ( glm::vec4(0,0,0,1) ),
-        emission ( glm::vec4(0,0,0,1) )
+        emission ( glm::vec4(0,0,0,1) ),
+        shininess( 0.0f )
     {}
 
     glm::vec4 atten, ambient, diffuse, specular, emission;
@@ -30,12 +35,17 @@ class MatSpec {
 class Object {
   public:
     Object(glm::mat4 xform, MatSpec &material) :
-        xform(xform), material(material)
+        material(material), xform(xform), ixform(glm::inverse(xform))
     {}
+    virtual ~Object() {}
     virtual void Render();
+    virtual void Build() {} // acceleration structures, before Bounds
+    virtual void Bounds(glm::vec3 &lo, glm::vec3 &hi);
+    virtual bool IntersectLocal(Ray &ray, float &t, glm::vec3 &normal);
+    bool Intersect(Ray &ray, Hit &hit);
 
     MatSpec material;
-    glm::mat4 xform;
+    glm::mat4 xform, ixform;
 };
 
 class Sphere : public Object {
@@ -44,6 +54,8 @@ class Sphere : public Object {
         Object(xform, material), r(r)
     {}
     virtual void Render();
+    virtual void Bounds(glm::vec3 &lo, glm::vec3 &hi);
+    virtual bool IntersectLocal(Ray &ray, float &t, glm::vec3 &normal);
 
     float r;
 };
@@ -53,6 +65,8 @@ class Tri : public Object {
     Tri(glm::mat4 xform, MatSpec &material, glm::vec3 v0, glm::vec3 v1, glm::vec3 v2) :
         Object(xform, material), v0(v0), v1(v1), v2(v2) { }
     virtual void Render();
+    virtual void Bounds(glm::vec3 &lo, glm::vec3 &hi);
+    virtual bool IntersectLocal(Ray &ray, float &t, glm::vec3 &normal);
 
     glm::vec3 v0, v1, v2;
 };
@@ -62,45 +76,101 @@ class TriNormal : public Object {
     TriNormal(glm::mat4 xform, MatSpec &material, vertnorm vn0, vertnorm vn1, vertnorm vn2) :
         Object(xform, material), vn0(vn0), vn1(vn1), vn2(vn2) { }
     void Render();
+    virtual void Bounds(glm::vec3 &lo, glm::vec3 &hi);
+    virtual bool IntersectLocal(Ray &ray, float &t, glm::vec3 &normal);
 
     vertnorm vn0, vn1, vn2;
 };
 
+/* Triangles from an OFF file, stored flat with smoothed vertex normals and
+ * their own BVH, so a large mesh is a single entry in the scene. */
+class Mesh : public Object {
+  public:
+    Mesh(glm::mat4 xform, MatSpec &material, const char *fname);
+    void Render();
+    virtual void Build();
+    virtual void Bounds(glm::vec3 &lo, glm::vec3 &hi);
+    virtual bool IntersectLocal(Ray &ray, float &t, glm::vec3 &normal);
+    bool IntersectPrim(int i, Ray &ray, Hit &hit);
+
+    std::vector<glm::vec3> verts, norms;
+    std::vector<int> tris; // three vertex indices per triangle
+    glm::vec3 lo, hi;      // object space bounds
+
+  private:
+    void ComputeNormals();
+
+    BVH bvh;
+};
+
 static int light_next_num = 0;
 class Light {
   public:
     Light(glm::mat4 xform, MatSpec &material, glm::vec4 pos, glm::vec4 color) :
-        pos(pos), material(material), xform(xform), color(color), lnum(light_next_num++)
+        material(material), pos(pos), color(color), tpos(xform * pos),
+        xform(xform), lnum(light_next_num++)
     {}
     void Init();
 
     MatSpec material;
     glm::vec4 pos, color;
+    glm::vec4 tpos; // pos in world space
     glm::mat4 xform;
     int lnum;
 };
 
+class Camera {
+  public:
+    Camera(glm::vec3 eye, glm::vec3 center, glm::vec3 up, float fov) :
+        eye(eye), center(center), up(up), fov(fov),
+        w( glm::normalize(eye - center) ),
+        u( glm::normalize(glm::cross(up, w)) ),
+        v( glm::cross(w, u) )
+    {}
+
+    glm::vec3 eye, center, up;
+    float fov;
+    glm::vec3 w, u, v; // camera frame, looking down -w
+};
+
 class Scene {
   public:
     Scene(char *scenefilename);
-    void RayTrace();
+    ~Scene();
+    /* false if an image could not be written */
+    bool RayTrace(bool save = true);
+    bool WavefrontTrace(bool save = true);
+    /* false if the window holds no pixels once clamped to the image */
+    bool SetCrop(int x0, int y0, int x1, int y1);
     void Preview();
     void Render();
-    glm::vec3 CastRay(glm::vec3 origin, glm::vec3 direction);
+    glm::vec3 CastRay(Ray &ray, long &nrays, int depth = 0);
+    bool IntersectPrim(int i, Ray &ray, Hit &hit) { return objs[i]->Intersect(ray, hit); }
+    Ray PrimaryRay(Camera &cam, int i, int j);
+    bool LightRay(Light *light, glm::vec3 p, glm::vec3 n, glm::vec3 v, MatSpec &m,
+            Ray &shadow, float &tmax, glm::vec3 &color);
 
-    float fov;
     int width, height, maxdepth;
+    int crop[4]; // x0 y0 x1 y1 of the pixel window to render
 
-  private:
-    std::string output_fname;
+    // statistics for bench
+    int NumObjects() { return objs.size(); }
+    double parseTime, buildTime; // seconds
+    long raysTraced;             // by the last render, including shadow rays
 
-    glm::vec3 eye, center, up;
+    std::vector<Camera> cameras;
+
+  private:
+    bool WriteImage(glm::vec3 *buffer, int camera);
 
+    std::string output_fname;
     std::vector<glm::vec3> verts;
     std::vector<vertnorm> vertnorms;
 
     std::vector<Object*> objs;
     std::vector<Light*> lights;
+
+    BVH bvh;
 };
 
 #endif /* _TRACE_SCENE_H_ */
@@ -0,0 +1,14 @@
+#ifndef _TRACE_TIMER_H_
+#define _TRACE_TIMER_H_
+
+#include <sys/time.h>
+
+/* wall-clock time in seconds */
+inline double
+Now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+#endif /* _TRACE_TIMER_H_ */
@@ -3,6 +3,7 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cmath>
+#include <cstring>
 
 #include <glm/glm.hpp>
 
@@ -75,29 +76,56 @@ int main(int argc, char *argv[])
 {
 	// Make sure that the output filename argument has been provided
 	if (argc < 2) {
-		fprintf(stderr, "Usage: %s path/to/scene.test\n", argv[0]);
+		fprintf(stderr, "Usage: %s [-p] [-w] [-c x0 y0 x1 y1] path/to/scene.test\n", argv[0]);
         exit(1);
 	}
 
-    bool preview = false;
+    bool preview = false,
+         wavefront = false;
+    char *scenefile = NULL;
+    int crop[4] = { 0, 0, -1, -1 };
 
-    int i = 1;
-    for (int i = 0; i < argc; i++) {
-        if (!strcmp(argv[i++],"-p"))
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i],"-p"))
             preview = true;
+        else if (!strcmp(argv[i],"-w"))
+            wavefront = true;
+        else if (!strcmp(argv[i],"-c")) {
+            if (i + 4 >= argc) {
+                fprintf(stderr, "-c needs x0 y0 x1 y1\n");
+                exit(1);
+            }
+            for (int k = 0; k < 4; k++)
+                crop[k] = atoi(argv[++i]);
+        }
+        else
+            scenefile = argv[i];
+    }
+
+    if (scenefile == NULL) {
+        fprintf(stderr, "Usage: %s [-p] [-w] [-c x0 y0 x1 y1] path/to/scene.test\n", argv[0]);
+        exit(1);
     }
 
     // parse scene file
-    Scene *s = new Scene((char*) argv[1]);
+    Scene *s = new Scene(scenefile);
+    if (crop[2] >= 0 && !s->SetCrop(crop[0], crop[1], crop[2], crop[3])) {
+        fprintf(stderr, "Crop window %d %d %d %d holds no pixels of the %dx%d image\n",
+                crop[0], crop[1], crop[2], crop[3], s->width, s->height);
+        exit(1);
+    }
 
+    bool written = true;
     if (preview)
         s->Preview();
+    else if (wavefront)
+        written = s->WavefrontTrace();
     else
-        s->RayTrace();
+        written = s->RayTrace();
 
     // release resources
     delete s;
 
-	return 0;
+	return written ? 0 : 1;
 }
 
@@ -0,0 +1,218 @@
+/**
+ * Wavefront integrator: instead of following one ray at a time through
+ * CastRay, every stage (generate, intersect, shade, shadow) runs over a whole
+ * batch of rays before the next one starts. Rays are sorted between stages
+ * so neighbouring work items touch the same BVH nodes and materials.
+ */
+
+#include "scene.h"
+#include "image.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#define WAVEFRONT_SIZE (1 << 18)
+
+using namespace glm;
+
+/* A ray in flight, tagged with the pixel it contributes to. */
+struct PathRay {
+    Ray ray;
+    vec3 weight;
+    int pixel, depth;
+};
+
+struct ShadowRay {
+    Ray ray;
+    float tmax;
+    vec3 color;
+    int pixel;
+};
+
+typedef std::pair<unsigned int, int> SortKey;
+
+/* spread the low 9 bits of x out to every third bit */
+static inline unsigned int
+spread(unsigned int x) {
+    x &= 0x1ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x <<  8)) & 0x0300f00f;
+    x = (x | (x <<  4)) & 0x030c30c3;
+    x = (x | (x <<  2)) & 0x09249249;
+    return x;
+}
+
+/* Reorder rays by direction octant, then by Morton code of the origin
+ * quantized to the bounds of the batch. */
+template <class R> static void
+sortRays(std::vector<R> &rays) {
+    int n = rays.size();
+    if (n < 2)
+        return;
+
+    vec3 lo( FLT_MAX), hi(-FLT_MAX);
+    for (int k = 0; k < n; k++) {
+        lo = min(lo, rays[k].ray.origin);
+        hi = max(hi, rays[k].ray.origin);
+    }
+    vec3 scale = 511.0f / max(hi - lo, vec3(1e-6f));
+
+    std::vector<SortKey> keys(n);
+    #pragma omp parallel for
+    for (int k = 0; k < n; k++) {
+        vec3 &d = rays[k].ray.direction;
+        vec3 q = (rays[k].ray.origin - lo) * scale;
+        unsigned int octant = (d.x < 0) | ((d.y < 0) << 1) | ((d.z < 0) << 2);
+        keys[k] = SortKey(octant << 27 |
+                spread(q.x) | spread(q.y) << 1 | spread(q.z) << 2, k);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<R> sorted(n);
+    #pragma omp parallel for
+    for (int k = 0; k < n; k++)
+        sorted[k] = rays[keys[k].second];
+    rays.swap(sorted);
+}
+
+bool
+Scene::WavefrontTrace(bool save) {
+    if (save)
+        printf("raytracing (wavefront)...\n");
+    int cw = crop[2] - crop[0],
+        ch = crop[3] - crop[1],
+        ncams = cameras.size();
+    int nframe = cw * ch,
+        npixels = ncams * nframe; // every camera's frame shares the wavefront
+    glm::vec3 *buffer = (glm::vec3*) calloc(npixels, sizeof(glm::vec3));
+
+    int nlights = lights.size();
+    std::vector<PathRay> rays, next;
+    std::vector<Hit> hits;
+    std::vector<SortKey> order;
+    std::vector<ShadowRay> shadows;
+    std::vector<char> blocked;
+    raysTraced = 0;
+
+    for (int start = 0; start < npixels; start += WAVEFRONT_SIZE) {
+        int end = std::min(npixels, start + WAVEFRONT_SIZE);
+
+        // -------------------------------------------------------------------
+        // generate camera rays
+
+        rays.resize(end - start);
+        #pragma omp parallel for
+        for (int k = start; k < end; k++) {
+            PathRay &pr = rays[k - start];
+            int f = k % nframe;
+            pr.ray = PrimaryRay(cameras[k / nframe], crop[1] + f / cw, crop[0] + f % cw);
+            pr.weight = vec3(1.0f);
+            pr.pixel = k;
+            pr.depth = 0;
+        }
+
+        while (!rays.empty()) {
+            int nrays = rays.size();
+            raysTraced += nrays;
+
+            // ---------------------------------------------------------------
+            // intersect
+
+            sortRays(rays);
+            hits.assign(nrays, Hit());
+            #pragma omp parallel for schedule(dynamic, 256)
+            for (int k = 0; k < nrays; k++)
+                bvh.Intersect(*this, rays[k].ray, hits[k]);
+
+            // ---------------------------------------------------------------
+            // shade, grouped by object so each material is loaded once
+
+            order.clear();
+            for (int k = 0; k < nrays; k++)
+                if (hits[k].obj >= 0)
+                    order.push_back(SortKey(hits[k].obj, k));
+            std::sort(order.begin(), order.end());
+
+            int nhits = order.size();
+            shadows.resize(nhits * nlights);
+            next.resize(nhits);
+
+            /* each pixel has at most one path ray per bounce, so writes to
+             * buffer don't race */
+            #pragma omp parallel for schedule(dynamic, 256)
+            for (int s = 0; s < nhits; s++) {
+                PathRay &pr = rays[order[s].second];
+                Hit &hit = hits[order[s].second];
+                MatSpec &m = objs[hit.obj]->material;
+
+                vec3 p = pr.ray.origin + hit.t * pr.ray.direction,
+                     n = normalize(hit.normal),
+                     v = -normalize(pr.ray.direction);
+                if (dot(n, v) < 0.0f)
+                    n = -n;
+
+                buffer[pr.pixel] += pr.weight * (vec3(m.ambient) + vec3(m.emission));
+
+                for (int l = 0; l < nlights; l++) {
+                    ShadowRay &sr = shadows[s*nlights + l];
+                    vec3 c;
+                    sr.pixel = -1;
+                    if (LightRay(lights[l], p, n, v, m, sr.ray, sr.tmax, c)) {
+                        sr.color = pr.weight * c;
+                        sr.pixel = pr.pixel;
+                    }
+                }
+
+                PathRay &nr = next[s];
+                vec3 spec(m.specular);
+                nr.pixel = -1;
+                if (pr.depth + 1 < maxdepth && spec != vec3(0.0f)) {
+                    nr.ray = Ray(p, reflect(pr.ray.direction, n));
+                    nr.weight = pr.weight * spec;
+                    nr.pixel = pr.pixel;
+                    nr.depth = pr.depth + 1;
+                }
+            }
+
+            // ---------------------------------------------------------------
+            // compact queues
+
+            int nshadows = 0;
+            for (int s = 0; s < (int) shadows.size(); s++)
+                if (shadows[s].pixel >= 0)
+                    shadows[nshadows++] = shadows[s];
+            shadows.resize(nshadows);
+
+            int nnext = 0;
+            for (int s = 0; s < nhits; s++)
+                if (next[s].pixel >= 0)
+                    next[nnext++] = next[s];
+            next.resize(nnext);
+
+            // ---------------------------------------------------------------
+            // trace shadow rays, then accumulate unblocked light serially
+            // since several lights can land on the same pixel
+
+            raysTraced += nshadows;
+            sortRays(shadows);
+            blocked.assign(nshadows, 0);
+            #pragma omp parallel for schedule(dynamic, 256)
+            for (int s = 0; s < nshadows; s++)
+                blocked[s] = bvh.Occluded(*this, shadows[s].ray, shadows[s].tmax);
+
+            for (int s = 0; s < nshadows; s++)
+                if (!blocked[s])
+                    buffer[shadows[s].pixel] += shadows[s].color;
+
+            rays.swap(next);
+        }
+    }
+
+    bool written = true;
+    if (save)
+        for (int c = 0; c < ncams; c++)
+            written &= WriteImage(&buffer[c*nframe], c);
+    free(buffer);
+    return written;
+}